@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdio>
 
 #include <gflags/gflags.h>
@@ -5,6 +6,7 @@
 #include "imgui.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/match.h"
+#include "audio/mel_features.h"
 #include "imwidget/error_dialog.h"
 #include "imwidget/fft_display.h"
 #include "imwidget/wave_display.h"
@@ -19,11 +21,73 @@
 #include "nfd.h"
 #endif
 
+DEFINE_bool(mmap, false, "Memory-map uncompressed WAV files instead of "
+                         "decoding them.  Only the first channel is shown.");
+DEFINE_double(analysis_rate, 0, "If nonzero, resample to this rate before "
+                                "computing the spectrogram.");
+DEFINE_int32(playback_quality, 1, "Playback resampler quality: "
+                                  "0=fast, 1=medium, 2=best.");
+DEFINE_string(fft_effort, "measure", "FFTW planner effort: estimate, "
+                                     "measure, patient or exhaustive.");
+DEFINE_bool(lazy_analysis, true, "Compute the spectrogram on demand for the "
+                                 "visible time range instead of all at once.");
+DEFINE_string(spectrum_storage, "db", "How spectrogram frames are stored: "
+              "db (2 bytes/bin), db_phase (4; adds phase, so the tooltip "
+              "shows instantaneous rather than bin frequencies) or complex "
+              "(8).");
+DEFINE_string(pyramid, "max", "Pooling for the zoomed-out spectrogram "
+                              "overview: max, mean or none.");
+DEFINE_bool(analysis_cache, true, "Save finished spectrograms and map them "
+                                  "back in when the same file is reopened; "
+                                  "see --analysis_cache_mb.");
+DEFINE_int32(constant_q, 0, "If nonzero, also compute a constant-Q "
+                            "spectrogram with this many bins per octave.");
+DEFINE_int32(analysis_threads, 0, "Threads used to compute the spectrogram; "
+                                  "0 uses every hardware thread.");
+DEFINE_bool(capture, false, "Show a live spectrogram of the default "
+                            "recording device.");
+
 
 namespace project {
+namespace {
+// Input samples read from the channel per resampler push during playback.
+constexpr size_t kPlayBlock = 1024;
+
+audio::FFTChannel::Effort PlannerEffort(const std::string& name) {
+    if (name == "estimate") return audio::FFTChannel::ESTIMATE;
+    if (name == "patient") return audio::FFTChannel::PATIENT;
+    if (name == "exhaustive") return audio::FFTChannel::EXHAUSTIVE;
+    if (name != "measure") {
+        LOG(ERROR, "Unknown --fft_effort ", name, "; using measure.");
+    }
+    return audio::FFTChannel::MEASURE;
+}
+
+audio::FrameStore::Format SpectrumStorage(const std::string& name) {
+    if (name == "complex") return audio::FrameStore::COMPLEX;
+    if (name == "db_phase") return audio::FrameStore::DB_PHASE;
+    if (name != "db") {
+        LOG(ERROR, "Unknown --spectrum_storage ", name, "; using db.");
+    }
+    return audio::FrameStore::DB;
+}
+}  // namespace
 
 void App::Init() {
     InitAudio(48000, 1, 1024, AUDIO_F32);
+    if (FLAGS_capture && InitCapture(48000, 1, 256, AUDIO_F32)) {
+        live_fft_ = absl::make_unique<audio::FFTChannel>();
+        live_fft_->set_effort(PlannerEffort(FLAGS_fft_effort));
+        live_fft_->set_storage(audio::FrameStore::DB);
+        live_fft_->Init(2048, 2048, audio::FFTChannel::WindowFn::HANN,
+                        audio::FFTChannel::Transform::REAL);
+        live_fft_->set_fragsz(256);
+        // About ten seconds of history at 48 kHz.
+        live_ = absl::make_unique<audio::StreamingSTFT>(
+                live_fft_.get(), capture_rate_, 2048);
+        live_cache_ = absl::make_unique<audio::LiveCache>(live_.get());
+        SDL_PauseAudioDevice(capture_device_, 0);
+    }
 }
 
 void App::ProcessEvent(SDL_Event* event) {
@@ -33,12 +97,68 @@ void App::ProcessMessage(const std::string& msg, const void* extra) {
 }
 
 void App::Load(const std::string& filename) {
-    wav_ = std::move(sound::File::LoadAsMono(filename));
-    wav_->channel(0)->set_interpolation(sound::Interpolation::Linear);
-    fft_.Init(4096, 4096, audio::FFTChannel::WindowFn::BLACKMAN);
-    fft_.set_fragsz(512);
-    fft_.Analyze(*wav_->channel(0));
-    cache_ = absl::make_unique<audio::FFTCache>(&fft_);
+    auto loader = absl::make_unique<audio::FileLoader>(filename);
+    loader->set_mmap(FLAGS_mmap);
+    loader->set_analysis_rate(FLAGS_analysis_rate);
+    loader->set_lazy(FLAGS_lazy_analysis);
+    loader->set_cache(FLAGS_analysis_cache);
+    if (FLAGS_constant_q > 0) loader->set_constant_q(FLAGS_constant_q);
+    if (FLAGS_pyramid == "max") {
+        loader->set_pyramid(audio::SpectrumPyramid::MAX);
+    } else if (FLAGS_pyramid == "mean") {
+        loader->set_pyramid(audio::SpectrumPyramid::MEAN);
+    } else if (FLAGS_pyramid != "none") {
+        LOG(ERROR, "Unknown --pyramid ", FLAGS_pyramid, "; using none.");
+    }
+    audio::FFTChannel* fft = loader->fft();
+    fft->set_effort(PlannerEffort(FLAGS_fft_effort));
+    fft->set_storage(SpectrumStorage(FLAGS_spectrum_storage));
+    fft->Init(4096, 4096, audio::FFTChannel::WindowFn::BLACKMAN,
+              audio::FFTChannel::Transform::REAL);
+    fft->set_fragsz(512);
+    fft->set_threads(FLAGS_analysis_threads);
+
+    // Swap loaders with the audio callback blocked; destroying the old
+    // loader cancels it and waits for its worker.
+    if (export_.valid()) export_.wait();
+    cache_.reset();
+    LockAudio();
+    transport_.playing = false;
+    loader_ = std::move(loader);
+    UnlockAudio();
+    loader_->Start();
+    SetTitle(filename);
+}
+
+void App::ExportFeatures(const std::string& filename) {
+    if (export_.valid()) export_.wait();
+    audio::FFTChannel* fft = loader_->fft();
+    auto channel = loader_->analysis_channel();
+    if (!channel) return;
+    export_ = std::async(std::launch::async, [fft, channel, filename]() {
+        audio::MelFeatures features;
+        if (!features.Init(channel->rate(), fft->fftsz(), fft->bins())) {
+            return false;
+        }
+        features.set_threads(FLAGS_analysis_threads);
+        return features.Analyze(*fft, *channel) && features.Save(filename);
+    });
+}
+
+void App::DrawLoadProgress() {
+    if (!loader_->busy()) return;
+    ImGui::SetNextWindowSize(ImVec2(400, 0), ImGuiSetCond_FirstUseEver);
+    if (ImGui::Begin("Loading")) {
+        ImGui::TextUnformatted(loader_->filename().c_str());
+        const char* what =
+            loader_->state() == audio::FileLoader::ANALYZING ? "Analyzing"
+                                                             : "Decoding";
+        ImGui::ProgressBar(loader_->progress(), ImVec2(-1, 0), what);
+        if (ImGui::Button("Cancel")) {
+            loader_->Cancel();
+        }
+    }
+    ImGui::End();
 }
 
 void App::Draw() {
@@ -47,10 +167,10 @@ void App::Draw() {
         if (ImGui::BeginMenu("File")) {
             if (ImGui::MenuItem("Open", "Ctrl+O")) {
                 char *filename = nullptr;
-                auto result = NFD_OpenDialog("z2prj;nes", nullptr, &filename);
+                auto result = NFD_OpenDialog("wav,flac,ogg,aiff,w64", nullptr,
+                                             &filename);
                 if (result == NFD_OKAY) {
-                    // DOSTUFF
-                    save_filename_.assign(filename);
+                    Load(filename);
                 }
                 free(filename);
             }
@@ -85,6 +205,16 @@ save_as:
                 }
                 free(filename);
             }
+            bool loaded = loader_ &&
+                          loader_->state() == audio::FileLoader::DONE;
+            if (ImGui::MenuItem("Export Features", nullptr, false, loaded)) {
+                char *filename = nullptr;
+                auto result = NFD_SaveDialog("feat", nullptr, &filename);
+                if (result == NFD_OKAY) {
+                    ExportFeatures(filename);
+                }
+                free(filename);
+            }
             ImGui::EndMenu();
         }
         if (ImGui::BeginMenu("Edit")) {
@@ -130,26 +260,97 @@ save_as:
     }
 #endif
 
-    if (wav_) {
+    if (export_.valid() && export_.wait_for(std::chrono::seconds(0)) ==
+                               std::future_status::ready) {
+        if (!export_.get()) {
+            ErrorDialog::Spawn("Error", "Could not export features.\n");
+        }
+    }
+
+    if (live_) {
+        live_->Process();
+        ImGui::SetNextWindowSize(ImVec2(800, 480), ImGuiSetCond_FirstUseEver);
+        if (ImGui::Begin("Live")) {
+            LiveDisplay("Input", live_cache_.get(), ImVec2(0, 400));
+        }
+        ImGui::End();
+    }
+
+    sound::File* wav = loader_ ? loader_->file() : nullptr;
+    if (wav) {
+        DrawLoadProgress();
+        double rate = wav->channel(0)->rate();
+        if (audio_rate_ && (!resampler_ || resampler_->in_rate() != rate)) {
+            auto quality = sound::Resampler::Quality(
+                    std::min(std::max(FLAGS_playback_quality, 0), 2));
+            auto rs = absl::make_unique<sound::Resampler>(
+                    rate, audio_rate_, quality, kPlayBlock);
+            LockAudio();
+            resampler_ = std::move(rs);
+            play_block_.resize(kPlayBlock);
+            play_time_ = -1;
+            UnlockAudio();
+        }
+        // Spectrogram columns are drawn as they're shown, so the cache can
+        // be created as soon as any fragments are available.
+        if (!cache_ && loader_->fft()->size()) {
+            cache_ = absl::make_unique<audio::FFTCache>(
+                    loader_->fft(), loader_->pyramid(),
+                    log_frequency_ ? loader_->cqt() : nullptr);
+        }
         if (ImGui::Begin("Wave")) {
             TransportWidget(&transport_);
-            WaveDisplay2("Waveform", wav_->channel(0), &time0_, &zoom_, &transport_);
-            FFTDisplay("Spectrogram", cache_.get(), &time0_, &zoom_, &vzoom_,
-                    &vzero_,
-                    &transport_,
-                    ImVec2(0, 640));
+            if (cache_ && loader_->cqt()) {
+                ImGui::SameLine();
+                if (ImGui::Checkbox("Log frequency", &log_frequency_)) {
+                    cache_.reset();
+                }
+            }
+            WaveDisplay2("Waveform", wav->channel(0), &time0_, &zoom_,
+                         &transport_);
+            if (cache_) {
+                FFTDisplay("Spectrogram", cache_.get(), &time0_, &zoom_,
+                        &vzoom_, &vzero_,
+                        &transport_,
+                        ImVec2(0, 640));
+            }
             ImGui::End();
         }
+    } else if (loader_ && loader_->state() == audio::FileLoader::FAILED) {
+        ErrorDialog::Spawn("Error",
+                "Could not open ", loader_->filename(), "\n");
+        LockAudio();
+        loader_.reset();
+        UnlockAudio();
     }
 }
 
 void App::AudioCallback(float* stream, int len) {
-    if (transport_.playing) {
+    sound::File* wav = loader_ ? loader_->file() : nullptr;
+    if (transport_.playing && wav && resampler_) {
+        auto channel = wav->channel(0);
+        if (transport_.time != play_time_) {
+            // The transport moved (or playback just started): restart the
+            // resampler at the new position.
+            resampler_->Reset();
+            play_pos_ = size_t(std::max(transport_.time, 0.0) *
+                               channel->rate());
+        }
         transport_.frame_time = transport_.time;
-        while(len--) {
-            *stream++ = wav_->channel(0)->at(transport_.time);
-            transport_.time += (1.0/48000.0);
+        int got = 0;
+        while(got < len) {
+            got += resampler_->Pull(stream + got, len - got);
+            if (got < len) {
+                // Paged channels can't fault on the audio thread; a
+                // page not yet read back plays as a moment of silence.
+                channel->ReadResident(play_pos_, play_block_.data(),
+                                      kPlayBlock);
+                resampler_->Push(play_block_.data(), kPlayBlock);
+                play_pos_ += kPlayBlock;
+            }
         }
+        transport_.time += double(len) / double(audio_rate_);
+        play_time_ = transport_.time;
     } else {
         while(len--) {
             *stream++ = 0.0;
@@ -157,6 +358,10 @@ void App::AudioCallback(float* stream, int len) {
     }
 }
 
+void App::CaptureCallback(const float* stream, int len) {
+    live_->Push(stream, len);
+}
+
 void App::Help(const std::string& topickey) {
 }
 
@@ -1,13 +1,17 @@
 #ifndef PROJECT_APP_H
 #define PROJECT_APP_H
+#include <future>
 #include <memory>
 #include <string>
 #include <SDL2/SDL.h>
 
 #include "imwidget/imapp.h"
 #include "util/sound/file.h"
-#include "audio/fft_channel.h"
+#include "util/sound/resampler.h"
+#include "audio/file_loader.h"
+#include "audio/stream_stft.h"
 #include "imwidget/fft_cache.h"
+#include "imwidget/live_display.h"
 #include "imwidget/transport.h"
 
 namespace project {
@@ -15,26 +19,47 @@ namespace project {
 class App: public ImApp {
   public:
     App(const std::string& name) : ImApp(name, 1280, 720) {}
-    ~App() override {}
+    ~App() override { CloseCapture(); }
 
     void Init() override;
     void ProcessEvent(SDL_Event* event) override;
     void ProcessMessage(const std::string& msg, const void* extra) override;
     void Draw() override;
+    // Starts loading |filename| in the background, cancelling any load
+    // already in progress.
     void Load(const std::string& filename);
 
     void Help(const std::string& topickey);
     void AudioCallback(float* stream, int len) override;
+    void CaptureCallback(const float* stream, int len) override;
   private:
+    void DrawLoadProgress();
+    // Writes the loaded file's mel features to |filename| in the
+    // background.
+    void ExportFeatures(const std::string& filename);
+
     std::string save_filename_;
-    std::unique_ptr<sound::File> wav_;
+    std::unique_ptr<audio::FileLoader> loader_;
     std::unique_ptr<audio::FFTCache> cache_;
-    audio::FFTChannel fft_;
+    // A feature export in progress.  Declared after loader_ so it is
+    // waited for before the loader goes away.
+    std::future<bool> export_;
+    // Converts the file's rate to the audio device's rate for playback.
+    std::unique_ptr<sound::Resampler> resampler_;
+    std::vector<float> play_block_;
+    size_t play_pos_ = 0;
+    double play_time_ = -1;
     double time0_ = 0;
     double zoom_ = 1;
     double vzoom_ = 1;
     double vzero_ = 0;
+    // Show the constant-Q spectrogram, when there is one.
+    bool log_frequency_ = true;
     Transport transport_ = {};
+    // The spectrogram of the capture device, with --capture.
+    std::unique_ptr<audio::FFTChannel> live_fft_;
+    std::unique_ptr<audio::StreamingSTFT> live_;
+    std::unique_ptr<audio::LiveCache> live_cache_;
 
 };
 
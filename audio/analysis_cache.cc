@@ -0,0 +1,241 @@
+#include "audio/analysis_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <utime.h>
+
+#include <gflags/gflags.h>
+#include "util/crc.h"
+#include "util/file.h"
+#include "util/logging.h"
+#include "util/mapped_file.h"
+#include "util/os.h"
+
+DEFINE_int64(analysis_cache_mb, 2048,
+             "Most MiB of saved spectrograms to keep; the least recently "
+             "used are deleted past it.  0 for no limit.");
+
+namespace audio {
+namespace {
+constexpr char kMagic[8] = {'W', 'V', 'L', 'X', 'S', 'P', 'E', 'C'};
+constexpr uint32_t kVersion = 1;
+// Frames start on a page boundary so the mapping is SIMD-aligned.
+constexpr uint64_t kDataOffset = 4096;
+// Samples hashed from each of kSpots places across the channel.
+constexpr size_t kSpots = 64;
+constexpr size_t kSpotSamples = 1024;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t content;
+    uint32_t params;
+    uint32_t format;
+    uint64_t frames;
+    uint64_t bins;
+    uint64_t data_offset;
+    double rate;
+    double length;
+};
+
+void Fill(Header* h, const AnalysisCache::Key& key,
+          const sound::Channel& channel, const FFTChannel& fft,
+          size_t frames) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, kMagic, sizeof(kMagic));
+    h->version = kVersion;
+    h->content = key.content;
+    h->params = key.params;
+    h->format = fft.storage();
+    h->frames = frames;
+    h->bins = fft.bins();
+    h->data_offset = kDataOffset;
+    h->rate = channel.rate();
+    h->length = channel.length();
+}
+
+FILE* Begin(const std::string& filename, const Header& h) {
+    ::File::MakeDirs(os::path::DataPath({"analysis"}));
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        LOG(ERROR, "AnalysisCache: could not create ", filename);
+        return nullptr;
+    }
+    std::vector<uint8_t> page(kDataOffset);
+    memcpy(page.data(), &h, sizeof(h));
+    if (fwrite(page.data(), page.size(), 1, fp) != 1) {
+        fclose(fp);
+        remove(filename.c_str());
+        return nullptr;
+    }
+    return fp;
+}
+}  // namespace
+
+AnalysisCache::Key AnalysisCache::MakeKey(const std::string& source,
+                                          const sound::Channel& channel,
+                                          const FFTChannel& fft) {
+    Key key;
+    uint32_t crc = Crc32(0, source.data(), source.size());
+    auto st = Stat::Filename(source);
+    if (st.ok()) {
+        int64_t id[] = {st.ValueOrDie().Size(),
+                        st.ValueOrDie().ModificationTime()};
+        crc = Crc32(crc, id, sizeof(id));
+    }
+    std::vector<float> spot(kSpotSamples);
+    uint64_t size = channel.size();
+    double rate = channel.rate();
+    crc = Crc32(crc, &size, sizeof(size));
+    crc = Crc32(crc, &rate, sizeof(rate));
+    for(size_t i=0; i<kSpots; ++i) {
+        channel.Read(size * i / kSpots, spot.data(), spot.size());
+        crc = Crc32(crc, spot.data(), spot.size() * sizeof(float));
+    }
+    key.content = crc;
+
+    int32_t p[] = {fft.fftsz(), fft.winsz(), fft.fragsz(), fft.bins(),
+                   fft.transform(), fft.storage()};
+    crc = Crc32(0, p, sizeof(p));
+    crc = Crc32(crc, fft.window(), fft.winsz() * sizeof(float));
+    crc = Crc32(crc, fft.correlation(), fft.bins() * sizeof(fftwf_complex));
+    key.params = crc;
+    return key;
+}
+
+std::string AnalysisCache::Filename(const Key& key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%08x%08x.spec", key.content, key.params);
+    return os::path::DataPath({"analysis", name});
+}
+
+bool AnalysisCache::Load(const Key& key, const sound::Channel& channel,
+                         FFTChannel* fft) {
+    std::string filename = Filename(key);
+    if (!::File::Access(filename).ok()) return false;
+    std::shared_ptr<MappedFile> map = MappedFile::Open(filename);
+    if (!map) return false;
+
+    Header h;
+    if (map->size() < int64_t(sizeof(h))) return false;
+    memcpy(&h, map->data(), sizeof(h));
+    size_t expect = fft->fragments(channel);
+    size_t bytes = h.frames * h.bins * FrameStore::BinSize(fft->storage());
+    if (memcmp(h.magic, kMagic, sizeof(kMagic)) || h.version != kVersion ||
+        h.content != key.content || h.params != key.params ||
+        h.format != uint32_t(fft->storage()) || h.frames != expect ||
+        h.bins != uint64_t(fft->bins()) || h.data_offset != kDataOffset ||
+        uint64_t(map->size()) < h.data_offset + bytes) {
+        LOG(WARN, "AnalysisCache: ignoring stale ", filename);
+        return false;
+    }
+    fft->Adopt(map, map->data() + h.data_offset, h.frames, h.rate, h.length);
+    // The modification time doubles as the last use for Trim.
+    utime(filename.c_str(), nullptr);
+    LOG(INFO, "AnalysisCache: loaded ", filename);
+    return true;
+}
+
+bool AnalysisCache::Save(const Key& key, const sound::Channel& channel,
+                         const FFTChannel& fft) {
+    const FrameStore& store = fft.store();
+    if (store.layout() != FrameStore::Layout::TIME_MAJOR) return false;
+    auto writer = Create(key, channel, fft);
+    if (!writer) return false;
+    if (fwrite(store.raw(), store.memory(), 1, writer->fp_) != 1) {
+        writer->ok_ = false;
+    }
+    writer->written_ = store.frames();
+    return writer->Finish();
+}
+
+void AnalysisCache::Trim(uint64_t budget, const std::string& keep) {
+    std::string dir = os::path::DataPath({"analysis"});
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    struct Entry {
+        int64_t used;
+        int64_t size;
+        std::string filename;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    while(struct dirent* e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name.size() < 5 || name.compare(name.size() - 5, 5, ".spec")) {
+            continue;
+        }
+        std::string filename = dir + "/" + name;
+        auto st = Stat::Filename(filename);
+        if (!st.ok()) continue;
+        entries.push_back({st.ValueOrDie().ModificationTime(),
+                           st.ValueOrDie().Size(), filename});
+        total += entries.back().size;
+    }
+    closedir(d);
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for(const auto& e : entries) {
+        if (total <= budget) break;
+        if (e.filename == keep) continue;
+        if (remove(e.filename.c_str()) == 0) {
+            total -= e.size;
+            LOG(INFO, "AnalysisCache: evicted ", e.filename);
+        }
+    }
+}
+
+std::unique_ptr<AnalysisCache::Writer> AnalysisCache::Create(
+        const Key& key, const sound::Channel& channel, const FFTChannel& fft) {
+    auto writer = std::unique_ptr<Writer>(new Writer);
+    writer->filename_ = Filename(key);
+    writer->tmpname_ = writer->filename_ + ".tmp";
+    writer->frames_ = fft.fragments(channel);
+    writer->frame_.Reset(1, fft.bins(), FrameStore::Layout::TIME_MAJOR,
+                         fft.storage());
+    Header h;
+    Fill(&h, key, channel, fft, writer->frames_);
+    writer->fp_ = Begin(writer->tmpname_, h);
+    if (!writer->fp_) return nullptr;
+    return writer;
+}
+
+AnalysisCache::Writer::~Writer() {
+    if (fp_) {
+        // Never finished: throw the partial entry away.
+        fclose(fp_);
+        remove(tmpname_.c_str());
+    }
+}
+
+bool AnalysisCache::Writer::Put(const fftwf_complex* bins) {
+    if (!ok_ || written_ >= frames_) return false;
+    frame_.Put(0, bins);
+    ok_ = fwrite(frame_.raw(), frame_.memory(), 1, fp_) == 1;
+    ++written_;
+    return ok_;
+}
+
+bool AnalysisCache::Writer::Finish() {
+    bool ok = ok_ && written_ == frames_;
+    ok = fclose(fp_) == 0 && ok;
+    fp_ = nullptr;
+    if (ok) ok = rename(tmpname_.c_str(), filename_.c_str()) == 0;
+    if (!ok) {
+        remove(tmpname_.c_str());
+        LOG(ERROR, "AnalysisCache: could not save ", filename_);
+        return false;
+    }
+    LOG(INFO, "AnalysisCache: saved ", filename_);
+    if (FLAGS_analysis_cache_mb > 0) {
+        Trim(uint64_t(FLAGS_analysis_cache_mb) << 20, filename_);
+    }
+    return true;
+}
+
+}  // namespace audio
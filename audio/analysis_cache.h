@@ -0,0 +1,74 @@
+#ifndef WVLX_AUDIO_ANALYSIS_CACHE_H
+#define WVLX_AUDIO_ANALYSIS_CACHE_H
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "audio/fft_channel.h"
+#include "util/sound/file.h"
+
+namespace audio {
+
+// Keeps finished analyses on disk under os::path::DataPath so a file can
+// be reopened without recomputing its spectrogram.  An entry is keyed by
+// a CRC of the source file's path, size and modification time together
+// with samples spread across the channel, and a CRC of everything that
+// shapes the result: sizes, window table, correlation and storage
+// format.  Entries are memory-mapped, so only the frames being viewed are
+// read from disk.  Saving an entry trims the cache to --analysis_cache_mb,
+// least recently loaded or saved first.
+class AnalysisCache {
+  public:
+    struct Key {
+        uint32_t content;
+        uint32_t params;
+    };
+
+    // Streams frames into a new entry; the entry only becomes visible
+    // when Finish succeeds.
+    class Writer {
+      public:
+        ~Writer();
+        // Appends the next fragment's bins.
+        bool Put(const fftwf_complex* bins);
+        bool Finish();
+      private:
+        friend class AnalysisCache;
+        Writer() = default;
+
+        FILE* fp_ = nullptr;
+        std::string filename_;
+        std::string tmpname_;
+        size_t frames_ = 0;
+        size_t written_ = 0;
+        FrameStore frame_;
+        bool ok_ = true;
+    };
+
+    // |source| is the file |channel| was decoded from.  Sampling alone
+    // can't tell apart files that differ only between the sampled spots,
+    // so a file that was edited, or a different file at the same spots,
+    // gets a new key from its path, size and modification time.
+    static Key MakeKey(const std::string& source,
+                       const sound::Channel& channel, const FFTChannel& fft);
+    static std::string Filename(const Key& key);
+
+    // If there is a valid entry for |key|, points |fft| at it and returns
+    // true.  |fft| must be configured as it was when the entry was saved.
+    static bool Load(const Key& key, const sound::Channel& channel,
+                     FFTChannel* fft);
+    // Saves every fragment of an analyzed, time-major |fft|.
+    static bool Save(const Key& key, const sound::Channel& channel,
+                     const FFTChannel& fft);
+    // Deletes the least recently used entries, other than |keep|, until
+    // the cache holds at most |budget| bytes.
+    static void Trim(uint64_t budget, const std::string& keep="");
+    // Starts an entry to be filled in fragment order, e.g. from a Sweep.
+    static std::unique_ptr<Writer> Create(const Key& key,
+                                          const sound::Channel& channel,
+                                          const FFTChannel& fft);
+};
+
+}  // namespace audio
+#endif // WVLX_AUDIO_ANALYSIS_CACHE_H
@@ -0,0 +1,313 @@
+#include "audio/cqt_channel.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <thread>
+
+#include "audio/fft_channel.h"
+#include "util/logging.h"
+#include "util/sound/vector.h"
+
+namespace audio {
+namespace {
+constexpr double pi = 3.14159265358979323846264338327950288;
+// Frames claimed by a worker at a time; see FFTChannel.
+constexpr int kChunkFrames = 64;
+}  // namespace
+
+CQTChannel::~CQTChannel() {
+    Free();
+}
+
+void CQTChannel::Free() {
+    std::lock_guard<std::mutex> lock(FFTChannel::planner_mutex());
+    for(auto& oct : octaves_) {
+        if (oct.plan) fftwf_destroy_plan(oct.plan);
+    }
+    octaves_.clear();
+}
+
+bool CQTChannel::Init(double rate, double fmin, double fmax,
+                      int bins_per_octave, int fragsz, float threshold) {
+    Free();
+    ready_ = 0;
+    total_ = 0;
+    rate_ = rate;
+    fmin_ = fmin;
+    fragsz_ = fragsz;
+    bins_per_octave_ = bins_per_octave;
+    q_ = 1.0 / (std::exp2(1.0 / bins_per_octave) - 1.0);
+    // Keep the top bin's band below Nyquist.
+    fmax = std::min(fmax, 0.5 * rate / std::exp2(1.0 / bins_per_octave));
+    bins_ = fmax > fmin
+        ? int(std::floor(bins_per_octave * std::log2(fmax / fmin))) + 1 : 0;
+    if (bins_ <= 0 || fragsz_ <= 0) {
+        LOG(ERROR, "CQTChannel: no bins between ", fmin, " and ", fmax, " Hz");
+        bins_ = 0;
+        return false;
+    }
+
+    // Split the bins into octaves from the top down; the lowest may be
+    // partial.
+    fftsz_ = 0;
+    for(int top=bins_, j=0; top > 0; top -= bins_per_octave, ++j) {
+        Octave oct;
+        oct.first = std::max(0, top - bins_per_octave);
+        oct.bins = top - oct.first;
+        oct.level = std::max(0, j - 1);
+        oct.decimation = 1 << oct.level;
+        MakeKernels(&oct, rate / oct.decimation, threshold);
+        fftsz_ = std::max(fftsz_, oct.fftsz);
+        octaves_.emplace_back(std::move(oct));
+    }
+    empty_.Reset(1, bins_);
+    LOG(INFO, "CQTChannel: ", bins_, " bins from ", fmin_, " Hz in ",
+        octaves_.size(), " octaves, fftsz ", fftsz_, ", ", nonzero(),
+        " kernel coefficients");
+    return true;
+}
+
+void CQTChannel::MakeKernels(Octave* oct, double rate, float threshold) {
+    int longest = int(std::ceil(q_ * rate / frequency(oct->first)));
+    int fftsz = 1;
+    while(fftsz < longest) fftsz *= 2;
+    int half = fftsz / 2 + 1;
+    oct->fftsz = fftsz;
+
+    // Transform each bin's temporal kernel, a Hann-windowed complex
+    // exponential centered in the frame and normalized so a full-scale
+    // sinusoid reads 0 dB, and keep the band of coefficients above the
+    // threshold.  Negative frequencies are negligible and dropped, so
+    // real-input spectra suffice.
+    fftwf_complex* kernel = fftwf_alloc_complex(fftsz);
+    float* in = fftwf_alloc_real(fftsz);
+    fftwf_plan kplan;
+    {
+        std::lock_guard<std::mutex> lock(FFTChannel::planner_mutex());
+        kplan = fftwf_plan_dft_1d(fftsz, kernel, kernel, FFTW_FORWARD,
+                                  FFTW_ESTIMATE);
+        // Workers execute on their own arrays of the same size.
+        oct->plan = fftwf_plan_dft_r2c_1d(fftsz, in, kernel, FFTW_ESTIMATE);
+    }
+    oct->lo.assign(oct->bins, 0);
+    oct->start.assign(oct->bins + 1, 0);
+    for(int k=0; k<oct->bins; ++k) {
+        double f = frequency(oct->first + k);
+        int len = std::min(fftsz, int(std::ceil(q_ * rate / f)));
+        int offset = (fftsz - len) / 2;
+        double sum = 0;
+        for(int n=0; n<len; ++n) {
+            sum += 0.5 - 0.5 * cos(2.0 * pi * (n + 0.5) / len);
+        }
+        std::fill(&kernel[0][0], &kernel[0][0] + 2 * fftsz, 0.0f);
+        for(int n=0; n<len; ++n) {
+            double w = (0.5 - 0.5 * cos(2.0 * pi * (n + 0.5) / len)) / sum;
+            // Phase is relative to the center of the frame.
+            double ph = 2.0 * pi * f * (offset + n - fftsz / 2) / rate;
+            kernel[offset + n][0] = w * cos(ph);
+            kernel[offset + n][1] = w * sin(ph);
+        }
+        fftwf_execute(kplan);
+
+        float peak = 0;
+        for(int j=0; j<half; ++j) {
+            peak = std::max(peak, std::hypot(kernel[j][0], kernel[j][1]));
+        }
+        int lo = half, hi = 0;
+        for(int j=0; j<half; ++j) {
+            if (std::hypot(kernel[j][0], kernel[j][1]) >= threshold * peak) {
+                lo = std::min(lo, j);
+                hi = j + 1;
+            }
+        }
+        oct->lo[k] = lo;
+        const float scale = 1.0f / float(fftsz);
+        for(int j=lo; j<hi; ++j) {
+            oct->kernel_re.push_back(kernel[j][0] * scale);
+            oct->kernel_im.push_back(kernel[j][1] * scale);
+        }
+        oct->start[k + 1] = oct->kernel_re.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(FFTChannel::planner_mutex());
+        fftwf_destroy_plan(kplan);
+    }
+    fftwf_free(kernel);
+    fftwf_free(in);
+}
+
+size_t CQTChannel::nonzero() const {
+    size_t n = 0;
+    for(const auto& oct : octaves_) {
+        n += oct.kernel_re.size();
+    }
+    return n;
+}
+
+size_t CQTChannel::fragments(const sound::Channel& channel) const {
+    size_t samples = channel.length() * channel.rate();
+    return (samples + fragsz_ - 1) / fragsz_;
+}
+
+FrameSpan CQTChannel::fft(size_t n) const {
+    if (n < ready_ && cache_.format() == FrameStore::Format::COMPLEX) {
+        return cache_.frame(n);
+    }
+    return empty_.frame(0);
+}
+
+float CQTChannel::PowerDb(size_t n, size_t bin) const {
+    if (n >= ready_ || bin >= size_t(bins_)) {
+        return -std::numeric_limits<float>::infinity();
+    }
+    return cache_.db(n, bin);
+}
+
+bool CQTChannel::PowerDb(size_t n, float* db, size_t count) const {
+    bool ok = n < ready_;
+    size_t b = 0;
+    if (ok) {
+        for(; b<count && b<size_t(bins_); ++b) {
+            db[b] = cache_.db(n, b);
+        }
+    }
+    for(; b<count; ++b) {
+        db[b] = -std::numeric_limits<float>::infinity();
+    }
+    return ok;
+}
+
+void CQTChannel::Compute(const std::vector<const sound::Channel*>& sources,
+                         size_t n, Scratch* scratch) {
+    float* in = scratch->in;
+    fftwf_complex* out = scratch->out;
+    float* re = scratch->re.data();
+    float* im = scratch->im.data();
+    double center = double(n) * fragsz_ + fragsz_ / 2;
+    for(const auto& oct : octaves_) {
+        // Frames are centered on the same instant at every rate.  When
+        // that falls between samples of a decimated copy, the frame is
+        // centered on the nearest one and the phase is rotated to match.
+        double c = center / oct.decimation;
+        long mid = std::lround(c);
+        double frac = c - mid;
+        // The frame may start before the channel; Read zero-fills past
+        // its end.
+        long start = mid - oct.fftsz / 2;
+        long skip = std::max(0L, -start);
+        std::fill(in, in + std::min(skip, long(oct.fftsz)), 0.0f);
+        if (skip < oct.fftsz) {
+            sources[oct.level]->Read(start + skip, in + skip,
+                                     oct.fftsz - skip);
+        }
+        fftwf_execute_dft_r2c(oct.plan, in, out);
+        sound::vector::Deinterleave(re, im, &out[0][0], oct.fftsz / 2 + 1);
+
+        // X . conj(K) over each bin's band.
+        double rate = rate_ / oct.decimation;
+        for(int k=0; k<oct.bins; ++k) {
+            const float* kr = oct.kernel_re.data() + oct.start[k];
+            const float* ki = oct.kernel_im.data() + oct.start[k];
+            const float* xr = re + oct.lo[k];
+            const float* xi = im + oct.lo[k];
+            size_t len = oct.start[k + 1] - oct.start[k];
+            float yr = sound::vector::Dot(xr, kr, len) +
+                       sound::vector::Dot(xi, ki, len);
+            float yi = sound::vector::Dot(xi, kr, len) -
+                       sound::vector::Dot(xr, ki, len);
+            fftwf_complex& y = scratch->row[oct.first + k];
+            if (frac != 0) {
+                double ph = 2.0 * pi * frequency(oct.first + k) * frac / rate;
+                float cs = std::cos(ph), sn = std::sin(ph);
+                y[0] = yr * cs - yi * sn;
+                y[1] = yr * sn + yi * cs;
+            } else {
+                y[0] = yr;
+                y[1] = yi;
+            }
+        }
+    }
+    cache_.Put(n, scratch->row);
+}
+
+void CQTChannel::Publish(int chunk, int chunks, int frames) {
+    std::lock_guard<std::mutex> lock(publish_mu_);
+    chunk_done_[chunk] = true;
+    while(chunk_ready_ < chunks && chunk_done_[chunk_ready_]) {
+        ++chunk_ready_;
+    }
+    ready_ = std::min(chunk_ready_ * kChunkFrames, frames);
+}
+
+void CQTChannel::AnalyzeWorker(
+        const std::vector<const sound::Channel*>& sources, int frames,
+        const std::atomic<bool>* cancel) {
+    int half = fftsz_ / 2 + 1;
+    Scratch scratch;
+    scratch.in = fftwf_alloc_real(fftsz_);
+    scratch.out = fftwf_alloc_complex(half);
+    scratch.row = fftwf_alloc_complex(bins_);
+    scratch.re.resize(half);
+    scratch.im.resize(half);
+    int chunks = (frames + kChunkFrames - 1) / kChunkFrames;
+    for(;;) {
+        int chunk = next_chunk_++;
+        if (chunk >= chunks) break;
+        int end = std::min((chunk + 1) * kChunkFrames, frames);
+        bool cancelled = false;
+        for(int n=chunk * kChunkFrames; n<end && !cancelled; ++n) {
+            Compute(sources, n, &scratch);
+            cancelled = cancel && *cancel;
+        }
+        // A partially computed chunk is never published.
+        if (cancelled) break;
+        Publish(chunk, chunks, frames);
+    }
+    fftwf_free(scratch.in);
+    fftwf_free(scratch.out);
+    fftwf_free(scratch.row);
+}
+
+void CQTChannel::Analyze(const sound::Channel& channel,
+                         const std::atomic<bool>* cancel) {
+    if (octaves_.empty()) return;
+    ready_ = 0;
+    length_ = channel.length();
+    int frames = fragments(channel);
+    cache_.Reset(frames, bins_, FrameStore::Layout::TIME_MAJOR, storage_);
+    total_ = frames;
+
+    // Each decimated copy is half the rate of the one before, so all of
+    // them together are no larger than the channel.
+    std::vector<std::shared_ptr<sound::Channel>> copies;
+    std::vector<const sound::Channel*> sources{&channel};
+    for(int level=1; level<=octaves_.back().level; ++level) {
+        if (cancel && *cancel) return;
+        copies.emplace_back(
+                sources.back()->Resample(sources.back()->rate() / 2));
+        sources.push_back(copies.back().get());
+    }
+
+    int chunks = (frames + kChunkFrames - 1) / kChunkFrames;
+    next_chunk_ = 0;
+    chunk_ready_ = 0;
+    chunk_done_.assign(chunks, false);
+
+    int threads = threads_;
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max(1, std::min(threads, chunks));
+    std::vector<std::thread> workers;
+    for(int t=1; t<threads; ++t) {
+        workers.emplace_back(&CQTChannel::AnalyzeWorker, this,
+                             std::cref(sources), frames, cancel);
+    }
+    AnalyzeWorker(sources, frames, cancel);
+    for(auto& w : workers) {
+        w.join();
+    }
+}
+
+}  // namespace audio
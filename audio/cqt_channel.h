@@ -0,0 +1,157 @@
+#ifndef WVLX_AUDIO_CQT_CHANNEL_H
+#define WVLX_AUDIO_CQT_CHANNEL_H
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <fftw3.h>
+#include "audio/frame_store.h"
+#include "util/sound/file.h"
+
+namespace audio {
+// A constant-Q transform: bins_per_octave() bins to the octave upward
+// from fmin(), each as wide as a fixed fraction of its frequency, so every
+// octave gets the same number of rows.
+//
+// Uses sparse spectral kernels: Init transforms each bin's windowed
+// complex exponential once and keeps only the band of coefficients
+// around its frequency.  The bins are computed an octave at a time over
+// decimated copies of the channel: the top two octaves at the channel's
+// rate and each lower one at half the rate of the one above, which keeps
+// every octave below the top under a quarter of its rate, clear of the
+// decimation filter.  A frame then costs one short real FFT per octave
+// plus a short dot product per bin, rather than one FFT as long as the
+// lowest bin's kernel.
+class CQTChannel {
+  public:
+    CQTChannel() {}
+    ~CQTChannel();
+
+    // Plans bins from |fmin| up to |fmax|, capped below Nyquist, for a
+    // channel of |rate|, with frames |fragsz| samples apart.  Kernel
+    // coefficients below |threshold| of a bin's peak are dropped.  Returns
+    // false if that leaves no bins.
+    bool Init(double rate, double fmin, double fmax, int bins_per_octave,
+              int fragsz, float threshold=0.0054f);
+    // Computes every frame of |channel| across threads() worker threads.
+    // Like FFTChannel::Analyze, frames are published in order, so the
+    // first size() may be read while analysis is still running.  Stops
+    // early if |cancel| becomes true.  The decimated copies live only
+    // for the duration of the call.
+    void Analyze(const sound::Channel& channel,
+                 const std::atomic<bool>* cancel=nullptr);
+    // The number of frames Analyze would compute for |channel|.
+    size_t fragments(const sound::Channel& channel) const;
+
+    // Frame |n| is centered on the middle of samples [n*fragsz,
+    // (n+1)*fragsz), so at(tm) is the frame around |tm|.
+    FrameSpan at(double tm) const {
+        return fft(size_t(tm * rate_) / fragsz_);
+    }
+    // A view of the bins() bins of frame |n|, or of zeros if it is not
+    // computed yet or storage() isn't COMPLEX.
+    FrameSpan fft(size_t n) const;
+    inline bool ready(size_t n) const { return n < ready_; }
+    // The power in dB of |bin| of frame |n|, 0 dB being a full-scale
+    // sinusoid at the bin's frequency, or -infinity if not computed yet.
+    float PowerDb(size_t n, size_t bin) const;
+    // Fills |db| with the power of the first |count| bins of frame |n|.
+    // Returns false, filling with -infinity, if it is not computed yet.
+    bool PowerDb(size_t n, float* db, size_t count) const;
+
+    // The center frequency of |bin| in Hz.
+    inline double frequency(double bin) const {
+        return fmin_ * std::exp2(bin / bins_per_octave_);
+    }
+    inline int bins() const { return bins_; }
+    inline int bins_per_octave() const { return bins_per_octave_; }
+    inline double fmin() const { return fmin_; }
+    // The ratio of each bin's frequency to its bandwidth.
+    inline double q() const { return q_; }
+    // The longest per-octave transform.
+    inline int fftsz() const { return fftsz_; }
+    inline int octaves() const { return octaves_.size(); }
+    inline int fragsz() const { return fragsz_; }
+    inline double rate() const { return rate_; }
+    inline double length() const { return length_; }
+    // Kernel coefficients kept across all bins.
+    size_t nonzero() const;
+    inline size_t size() const { return ready_; }
+    inline double progress() const {
+        size_t total = total_;
+        return total ? double(ready_) / double(total) : 0.0;
+    }
+    // The number of analysis threads; 0 uses every hardware thread.
+    inline int threads() const { return threads_; }
+    inline void set_threads(int t) { threads_ = t; }
+    inline const FrameStore& store() const { return cache_; }
+    // How frames are stored by the next Analyze; DB is a quarter the size
+    // of COMPLEX.  PowerDb works with any format.
+    inline FrameStore::Format storage() const { return storage_; }
+    inline void set_storage(FrameStore::Format f) { storage_ = f; }
+
+  private:
+    // The bins of one octave, computed from a copy of the channel
+    // decimated by |decimation|.
+    struct Octave {
+        int first = 0;
+        int bins = 0;
+        int decimation = 1;
+        // log2(decimation): which decimated copy to read.
+        int level = 0;
+        int fftsz = 0;
+        fftwf_plan plan = nullptr;
+        // Bin first+k's kernel covers spectral bins [lo[k], lo[k] + len)
+        // where len is start[k+1] - start[k]; its coefficients, already
+        // scaled by 1/fftsz, are kernel_re/kernel_im[start[k]...].
+        std::vector<int> lo;
+        std::vector<int> start;
+        std::vector<float> kernel_re;
+        std::vector<float> kernel_im;
+    };
+    // Per-thread buffers for Compute, sized for the longest octave.
+    struct Scratch {
+        float* in;
+        fftwf_complex* out;
+        fftwf_complex* row;
+        std::vector<float> re;
+        std::vector<float> im;
+    };
+
+    void Free();
+    // Transforms octave |oct| at |rate| into its sparse kernels.
+    void MakeKernels(Octave* oct, double rate, float threshold);
+    // Computes every octave of frame |n| from |sources|, the channel and
+    // its decimated copies, and stores it as frame |n| of cache_.
+    void Compute(const std::vector<const sound::Channel*>& sources,
+                 size_t n, Scratch* scratch);
+    void AnalyzeWorker(const std::vector<const sound::Channel*>& sources,
+                       int frames, const std::atomic<bool>* cancel);
+    void Publish(int chunk, int chunks, int frames);
+
+    double rate_ = 0;
+    double length_ = 0;
+    double fmin_ = 0;
+    double q_ = 0;
+    int bins_ = 0;
+    int bins_per_octave_ = 12;
+    int fftsz_ = 0;
+    int fragsz_ = 512;
+    int threads_ = 0;
+    FrameStore::Format storage_ = FrameStore::Format::COMPLEX;
+    // Top octave first.
+    std::vector<Octave> octaves_;
+
+    FrameStore cache_;
+    FrameStore empty_;
+    std::atomic<size_t> ready_{0};
+    std::atomic<size_t> total_{0};
+    std::atomic<int> next_chunk_{0};
+    std::mutex publish_mu_;
+    std::vector<bool> chunk_done_;
+    int chunk_ready_ = 0;
+};
+
+}  // namespace audio
+#endif // WVLX_AUDIO_CQT_CHANNEL_H
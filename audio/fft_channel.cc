@@ -1,59 +1,407 @@
 #include "audio/fft_channel.h"
-#include "absl/memory/memory.h"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+#include "util/file.h"
+#include "util/logging.h"
+#include "util/os.h"
+#include "util/sound/math.h"
+#include "util/sound/vector.h"
 
 namespace audio {
 namespace {
-constexpr double pi = 3.14159265358979323846264338327950288;
+// Buckets claimed by a worker at a time.  Large enough to amortize the
+// claim, small enough that the published prefix advances smoothly.
+constexpr int kChunkBuckets = 64;
+
+// The FFTW planner and wisdom functions are not thread-safe.
+std::mutex planner_mu;
+bool wisdom_loaded = false;
+
+unsigned PlannerFlags(FFTChannel::Effort effort) {
+    switch(effort) {
+        case FFTChannel::ESTIMATE: return FFTW_ESTIMATE;
+        case FFTChannel::MEASURE: return FFTW_MEASURE;
+        case FFTChannel::PATIENT: return FFTW_PATIENT;
+        case FFTChannel::EXHAUSTIVE: return FFTW_EXHAUSTIVE;
+    }
+    return FFTW_ESTIMATE;
 }
 
-float FFTChannel::Rectangular(float n) {
-    return 1.0f;
+// A generalized cosine window: sum of (-1)^k a[k] cos(2 pi k n / N).
+double Cosine(const double* a, int terms, double n, double N) {
+    double w = 0;
+    for(int k=0; k<terms; ++k) {
+        w += (k & 1 ? -a[k] : a[k]) * cos(2.0 * pi * k * n / N);
+    }
+    return w;
 }
 
-float FFTChannel::Blackman(float n) {
-    // https://en.wikipedia.org/wiki/Window_function#Blackman_window
-    const float a0 = 7938.0/18608.0;                                             
-    const float a1 = 9240.0/18608.0;                                             
-    const float a2 = 1430.0/18608.0;                                             
-    const float N = winsz_ - 1;                                               
-    return a0 - a1*cosf(2.0*pi*n/N) + a2*cosf(4.0*pi*n/N);
+// Window coefficient |n| of a window of |size| samples.
+// https://en.wikipedia.org/wiki/Window_function
+float Window(FFTChannel::WindowFn wf, double param, int n, int size) {
+    const double N = size > 1 ? size - 1 : 1;
+    switch(wf) {
+        case FFTChannel::RECTANGULAR:
+            return 1.0f;
+        case FFTChannel::BLACKMAN: {
+            // Exact Blackman, evaluated in float as it always has been.
+            const float a0 = 7938.0/18608.0;
+            const float a1 = 9240.0/18608.0;
+            const float a2 = 1430.0/18608.0;
+            const float fN = size - 1;
+            const float fn = n;
+            return a0 - a1*cosf(2.0*pi*fn/fN) + a2*cosf(4.0*pi*fn/fN);
+        }
+        case FFTChannel::HANN: {
+            static const double a[] = {0.5, 0.5};
+            return Cosine(a, 2, n, N);
+        }
+        case FFTChannel::HAMMING: {
+            static const double a[] = {0.54, 0.46};
+            return Cosine(a, 2, n, N);
+        }
+        case FFTChannel::BLACKMAN_HARRIS: {
+            static const double a[] = {0.35875, 0.48829, 0.14128, 0.01168};
+            return Cosine(a, 4, n, N);
+        }
+        case FFTChannel::FLAT_TOP: {
+            static const double a[] = {0.21557895, 0.41663158, 0.277263158,
+                                       0.083578947, 0.006947368};
+            return Cosine(a, 5, n, N);
+        }
+        case FFTChannel::KAISER: {
+            double beta = param ? param : 8.6;
+            double r = 2.0 * n / N - 1.0;
+            return sound::BesselI0(beta * sqrt(std::max(0.0, 1.0 - r*r))) /
+                   sound::BesselI0(beta);
+        }
+        case FFTChannel::GAUSSIAN: {
+            double sigma = param ? param : 0.4;
+            double r = (n - N / 2.0) / (sigma * N / 2.0);
+            return exp(-0.5 * r * r);
+        }
+    }
+    return 1.0f;
 }
+}  // namespace
 
-void FFTChannel::Init(int n, int w, WindowFn wf) {
+void FFTChannel::Init(int n, int w, WindowFn wf, Transform tf) {
+    StopLazy();
     fftsz_ = n;
     winsz_ = w ? w : n;
     winfn_ = wf;
-    if (in_) {
-        fftwf_destroy_plan(plan_);
-        fftwf_free(in_);
-        fftwf_free(out_);
-    }
-    in_ = fftwf_alloc_complex(fftsz_);
-    out_ = fftwf_alloc_complex(fftsz_);
-    plan_ = fftwf_plan_dft_1d(fftsz_, in_, out_, FFTW_FORWARD, FFTW_ESTIMATE);
-    empty_ = absl::make_unique<Fragment>(fftsz_);
-    correlation_ = absl::make_unique<Fragment>(fftsz_);
+    transform_ = tf;
+    bins_ = tf == Transform::REAL ? n / 2 + 1 : n;
+    FreeArrays();
+    window_ = fftwf_alloc_real(winsz_);
+    SetWindow(wf);
+    out_ = fftwf_alloc_complex(bins_);
+    if (transform_ == Transform::REAL) {
+        rin_ = fftwf_alloc_real(fftsz_);
+    } else {
+        in_ = fftwf_alloc_complex(fftsz_);
+    }
+
+    unsigned flags = PlannerFlags(effort_);
+    bool learned = false;
+    // Above ESTIMATE, try to plan from wisdom alone first, so wisdom is
+    // only saved when the planner actually measured something new.
+    auto make = [&](const std::function<fftwf_plan(unsigned)>& plan) {
+        fftwf_plan p = nullptr;
+        if (effort_ != Effort::ESTIMATE) p = plan(flags | FFTW_WISDOM_ONLY);
+        if (p == nullptr) {
+            p = plan(flags);
+            learned = effort_ != Effort::ESTIMATE;
+        }
+        return p;
+    };
+    {
+        std::lock_guard<std::mutex> lock(planner_mu);
+        DestroyPlans();
+        if (effort_ != Effort::ESTIMATE && !wisdom_loaded) {
+            fftwf_import_wisdom_from_filename(WisdomFile().c_str());
+            wisdom_loaded = true;
+        }
+        plan_ = make([&](unsigned f) {
+            if (transform_ == Transform::REAL) {
+                return fftwf_plan_dft_r2c_1d(fftsz_, rin_, out_, f);
+            }
+            return fftwf_plan_dft_1d(fftsz_, in_, out_, FFTW_FORWARD, f);
+        });
+        if (batch_ > 1) {
+            // Planning may scribble on the arrays, so plan on scratch
+            // blocks; the workers execute on their own.
+            int size[] = {fftsz_};
+            fftwf_complex* out = fftwf_alloc_complex(batch_ * bins_);
+            if (transform_ == Transform::REAL) {
+                float* in = fftwf_alloc_real(batch_ * fftsz_);
+                batch_plan_ = make([&](unsigned f) {
+                    return fftwf_plan_many_dft_r2c(
+                            1, size, batch_, in, nullptr, 1, fftsz_,
+                            out, nullptr, 1, bins_, f);
+                });
+                fftwf_free(in);
+            } else {
+                fftwf_complex* in = fftwf_alloc_complex(batch_ * fftsz_);
+                batch_plan_ = make([&](unsigned f) {
+                    return fftwf_plan_many_dft(
+                            1, size, batch_, in, nullptr, 1, fftsz_,
+                            out, nullptr, 1, bins_, FFTW_FORWARD, f);
+                });
+                fftwf_free(in);
+            }
+            fftwf_free(out);
+        }
+    }
+    if (learned) SaveWisdom();
+    empty_.Reset(1, bins_);
+    correlation_ = std::vector<fftwf_complex>(bins_);
     if (w) MakeCorrelation();
 }
 
-FFTChannel::~FFTChannel() {
-    fftwf_destroy_plan(plan_);
+std::mutex& FFTChannel::planner_mutex() {
+    return planner_mu;
+}
+
+std::string FFTChannel::WisdomFile() {
+    return os::path::DataPath({"fftw_wisdom"});
+}
+
+bool FFTChannel::LoadWisdom() {
+    std::lock_guard<std::mutex> lock(planner_mu);
+    wisdom_loaded = true;
+    return fftwf_import_wisdom_from_filename(WisdomFile().c_str()) != 0;
+}
+
+bool FFTChannel::SaveWisdom() {
+    std::lock_guard<std::mutex> lock(planner_mu);
+    ::File::MakeDirs(os::path::DataPath());
+    std::string filename = WisdomFile();
+    if (!fftwf_export_wisdom_to_filename(filename.c_str())) {
+        LOG(ERROR, "Could not save FFTW wisdom to ", filename);
+        return false;
+    }
+    return true;
+}
+
+void FFTChannel::SetWindow(WindowFn wf, double param) {
+    winfn_ = wf;
+    for(int i=0; i<winsz_; ++i) {
+        window_[i] = Window(wf, param, i, winsz_);
+    }
+}
+
+void FFTChannel::Free() {
+    {
+        std::lock_guard<std::mutex> lock(planner_mu);
+        DestroyPlans();
+    }
+    FreeArrays();
+}
+
+void FFTChannel::DestroyPlans() {
+    if (plan_) fftwf_destroy_plan(plan_);
+    if (batch_plan_) fftwf_destroy_plan(batch_plan_);
+    plan_ = nullptr;
+    batch_plan_ = nullptr;
+}
+
+void FFTChannel::FreeArrays() {
+    fftwf_free(window_);
+    fftwf_free(rin_);
     fftwf_free(in_);
     fftwf_free(out_);
+    window_ = nullptr;
+    rin_ = nullptr;
+    in_ = nullptr;
+    out_ = nullptr;
+}
+
+FFTChannel::~FFTChannel() {
+    StopLazy();
+    Free();
+}
+
+FrameSpan FFTChannel::fft(size_t n) const {
+    std::unique_lock<std::mutex> lock(lazy_mu_, std::defer_lock);
+    if (lazy_) lock.lock();
+    long i = Index(n);
+    if (i < 0 || cache_.format() != FrameStore::Format::COMPLEX) {
+        return empty_.frame(0);
+    }
+    return cache_.frame(i);
+}
+
+bool FFTChannel::ready(size_t n) const {
+    std::unique_lock<std::mutex> lock(lazy_mu_, std::defer_lock);
+    if (lazy_) lock.lock();
+    return Index(n) >= 0;
+}
+
+void FFTChannel::Attach(std::shared_ptr<const sound::Channel> channel) {
+    StopLazy();
+    std::lock_guard<std::mutex> lock(lazy_mu_);
+    source_ = channel;
+    ready_ = 0;
+    length_ = channel->length();
+    rate_ = channel->rate();
+    MakeAdvance();
+    size_t buckets = fragments(*channel);
+    size_t slots = std::min(cache_frames_, buckets);
+    total_ = buckets;
+    cache_.Reset(slots, bins_, layout_, storage_);
+    slot_of_.assign(buckets, -1);
+    frag_of_slot_.assign(slots, kNoFragment);
+    pinned_.assign(slots, 0);
+    lru_.clear();
+    lru_pos_.clear();
+    for(size_t i=0; i<slots; ++i) {
+        lru_pos_.push_back(lru_.insert(lru_.end(), int(i)));
+    }
+    pending_.clear();
+    generation_ = 1;
+    stop_ = false;
+    lazy_ = true;
+    lazy_thread_ = std::thread(&FFTChannel::LazyWorker, this);
+}
+
+void FFTChannel::Adopt(std::shared_ptr<const void> backing, const void* data,
+                       size_t frames, double rate, double length) {
+    StopLazy();
+    ready_ = 0;
+    rate_ = rate;
+    length_ = length;
+    MakeAdvance();
+    cache_.Adopt(backing, data, frames, bins_,
+                 FrameStore::Layout::TIME_MAJOR, storage_);
+    total_ = frames;
+    ready_ = frames;
+}
+
+void FFTChannel::StopLazy() {
+    {
+        std::lock_guard<std::mutex> lock(lazy_mu_);
+        stop_ = true;
+    }
+    lazy_cv_.notify_all();
+    if (lazy_thread_.joinable()) {
+        lazy_thread_.join();
+    }
+    lazy_ = false;
+    source_.reset();
+}
+
+void FFTChannel::Request(double t0, double dt, int count) {
+    if (!lazy_ || count <= 0) return;
+    std::lock_guard<std::mutex> lock(lazy_mu_);
+    if (t0 > last_t0_) {
+        direction_ = 1;
+    } else if (t0 < last_t0_) {
+        direction_ = -1;
+    }
+    last_t0_ = t0;
+    ++generation_;
+    pending_.clear();
+
+    // The visible fragments come first; any already computed are marked
+    // most recently used and pinned so the worker won't evict them.
+    size_t last = kNoFragment;
+    auto fragment = [&](double t) {
+        return t < 0 ? kNoFragment : size_t(t * rate_) / fragsz_;
+    };
+    for(int i=0; i<count; ++i) {
+        size_t n = fragment(t0 + i * dt);
+        if (n == last || n >= slot_of_.size()) continue;
+        last = n;
+        int slot = slot_of_[n];
+        if (slot >= 0) {
+            lru_.splice(lru_.begin(), lru_, lru_pos_[slot]);
+            pinned_[slot] = generation_;
+        } else {
+            pending_.emplace_back(n, true);
+        }
+    }
+    // Then the next screenful in the direction of travel.
+    if (direction_) {
+        double t = direction_ > 0 ? t0 + count * dt : t0 - dt;
+        last = kNoFragment;
+        for(int i=0; i<count; ++i, t += direction_ * dt) {
+            size_t n = fragment(t);
+            if (n == last || n >= slot_of_.size()) continue;
+            last = n;
+            if (slot_of_[n] < 0) pending_.emplace_back(n, false);
+        }
+    }
+    lazy_cv_.notify_one();
+}
+
+int FFTChannel::Evict() {
+    // Called with lazy_mu_ held.  Takes the least recently used slot that
+    // is not showing in the current view.
+    for(auto it = lru_.rbegin(); it != lru_.rend(); ++it) {
+        int slot = *it;
+        if (pinned_[slot] == generation_) continue;
+        if (frag_of_slot_[slot] != kNoFragment) {
+            slot_of_[frag_of_slot_[slot]] = -1;
+            frag_of_slot_[slot] = kNoFragment;
+        }
+        return slot;
+    }
+    return -1;
+}
+
+void FFTChannel::LazyWorker() {
+    std::vector<float> frame(winsz_);
+    bool real = transform_ == Transform::REAL;
+    float* rin = real ? fftwf_alloc_real(fftsz_) : nullptr;
+    fftwf_complex* in = real ? nullptr : fftwf_alloc_complex(fftsz_);
+    fftwf_complex* out = fftwf_alloc_complex(bins_);
+
+    std::unique_lock<std::mutex> lock(lazy_mu_);
+    for(;;) {
+        lazy_cv_.wait(lock, [&]() { return stop_ || !pending_.empty(); });
+        if (stop_) break;
+        size_t n = pending_.front().first;
+        bool visible = pending_.front().second;
+        pending_.pop_front();
+        if (slot_of_[n] >= 0) continue;
+
+        lock.unlock();
+        Compute(*source_, n, frame.data(), rin, in, out);
+        lock.lock();
+
+        int slot = Evict();
+        if (slot < 0) continue;
+        // Readers only look up slots under the lock, and never a slot that
+        // is unmapped, so the copy itself can happen under the lock too.
+        Finish(slot, out);
+        slot_of_[n] = slot;
+        frag_of_slot_[slot] = n;
+        if (visible) pinned_[slot] = generation_;
+        lru_.splice(lru_.begin(), lru_, lru_pos_[slot]);
+    }
+    lock.unlock();
+    fftwf_free(rin);
+    fftwf_free(in);
+    fftwf_free(out);
 }
 
 std::pair<float, float> FFTChannel::MagnitudeAt(double tm, size_t bin) const {
     size_t n = size_t(tm * rate_) / fragsz_;
-    const auto* f1 = fft(n);
-    if (bin >= f1->size()) {
+    if (bin >= size_t(bins_)) {
         return std::make_pair(-std::numeric_limits<float>::infinity(),
                               -std::numeric_limits<float>::infinity());
     }
-    float re = (*f1)[bin][0];
-    float im = (*f1)[bin][1];
-    float phase = atan2(im, re);
-    const auto* f0 = fft(n-1);
-    float p0 = atan2((*f0)[bin][1], (*f0)[bin][0]);
+    float power = PowerDb(n, bin);
+    if (!cache_.has_phase()) {
+        // Without phase the best estimate is the bin's center.
+        return std::make_pair(power, float(bin * rate_ / fftsz_));
+    }
+    float phase = Phase(n, bin);
+    float p0 = Phase(n-1, bin);
 
     float oversamp = float(fftsz_) / float(fragsz_);
     float expect = float(bin) * 2.0 * pi * float(fragsz_) / float(fftsz_);
@@ -66,59 +414,321 @@ std::pair<float, float> FFTChannel::MagnitudeAt(double tm, size_t bin) const {
     //phase = fmodf(phase-p0-expect, pi);
     phase = phase * oversamp / (2.0 * pi);
     float freq = (rate_ / fftsz_) * (float(bin) + phase);
-
-    float power = 20.0f * log10f(2.0f * sqrtf(re*re + im*im));
     return std::make_pair(power, freq);
 }
 
-float FFTChannel::Windowed(float samp, int wpos) {
-    if (wpos < winsz_) {
-        switch(winfn_) {
-            case RECTANGULAR:
-                return samp;
-            case BLACKMAN:
-                return samp * Blackman(wpos);
+size_t FFTChannel::InstantFrequency(size_t n, size_t frames, float* db,
+                                    float* freq) const {
+    if (frames == 0) return 0;
+    // Two phase rows, swapped as the frames advance.
+    std::vector<float> phase(2 * bins_);
+    float* cur = phase.data();
+    float* prev = cur + bins_;
+    // What was stored counts, not storage_, which may have changed since.
+    bool has_phase = cache_.has_phase();
+    bool have_prev = false;
+    size_t computed = 0;
+    std::unique_lock<std::mutex> lock(lazy_mu_, std::defer_lock);
+    if (n > 0 && has_phase) {
+        if (lazy_) lock.lock();
+        long i = Index(n - 1);
+        if (i >= 0) {
+            cache_.Polar(i, db, prev);
+            have_prev = true;
         }
+        if (lazy_) lock.unlock();
+    }
+    for(size_t k=0; k<frames; ++k, db += bins_, freq += bins_) {
+        if (lazy_) lock.lock();
+        long i = Index(n + k);
+        if (i >= 0) cache_.Polar(i, db, has_phase ? cur : nullptr);
+        if (lazy_) lock.unlock();
+        if (i < 0) {
+            std::fill(db, db + bins_, -std::numeric_limits<float>::infinity());
+            std::copy(centers_.begin(), centers_.end(), freq);
+            have_prev = false;
+            continue;
+        }
+        ++computed;
+        if (have_prev) {
+            InstantFrequency(cur, prev, freq);
+        } else {
+            std::copy(centers_.begin(), centers_.end(), freq);
+        }
+        std::swap(cur, prev);
+        have_prev = has_phase;
+    }
+    return computed;
+}
+
+void FFTChannel::InstantFrequency(const float* phase, const float* prev,
+                                  float* freq) const {
+    // The deviation from the expected advance, wrapped onto +/- pi, is
+    // the offset from the bin's center in radians per fragment.  It is
+    // built up in |freq| itself, so a Sweep can call this on every
+    // fragment without allocating.
+    sound::vector::ScaleSub(freq, phase, 1.0f, prev, bins_);
+    sound::vector::ScaleSub(freq, freq, 1.0f, advance_.data(), bins_);
+    sound::vector::WrapPi(freq, freq, bins_);
+    sound::vector::Scale(freq, freq, float(rate_ / (2.0 * pi * fragsz_)),
+                         bins_);
+    sound::vector::MulAdd(freq, centers_.data(), 1.0f, bins_);
+}
+
+void FFTChannel::MakeAdvance() {
+    advance_.resize(bins_);
+    centers_.resize(bins_);
+    for(int b=0; b<bins_; ++b) {
+        advance_[b] = fmod(2.0 * pi * b * fragsz_ / fftsz_, 2.0 * pi);
+        centers_[b] = b * rate_ / fftsz_;
     }
-    return 0;
 }
 
 void FFTChannel::MakeCorrelation() {
+    // The bins of a real transform are the first fftsz/2+1 bins of the
+    // complex one, so the correlation is computed with the same plan.
     for(int i=0; i<fftsz_; ++i) {
-        in_[i][0] = i<winsz_ ? 1.0 : 0.0;
-        in_[i][1] = 0;
+        if (rin_) {
+            rin_[i] = i<winsz_ ? 1.0 : 0.0;
+        } else {
+            in_[i][0] = i<winsz_ ? 1.0 : 0.0;
+            in_[i][1] = 0;
+        }
     }
     fftwf_execute(plan_);
     double scale = 1.0 / double(fftsz_);
-    for(int i=0; i<fftsz_; ++i) {
-        (*correlation_)[i][0] = out_[i][0] * scale;
-        (*correlation_)[i][1] = out_[i][1] * scale;
+    for(int i=0; i<bins_; ++i) {
+        correlation_[i][0] = out_[i][0] * scale;
+        correlation_[i][1] = out_[i][1] * scale;
     }
 }
 
-void FFTChannel::Analyze(const sound::Channel& channel) {
-    length_ = channel.length();
-    rate_ = channel.rate();
-    int samples = length_ * rate_;
-    int buckets = (samples + fragsz_ - 1) / fragsz_;
-    
-    int s = 0;
-    for(int b=0; b<buckets; ++b) {
+void FFTChannel::Gather(const sound::Channel& channel, size_t bucket,
+                        float* frame, float* rin, fftwf_complex* in) const {
+    // Read each window in one block so paged or mapped channels only
+    // touch the samples they need.
+    channel.Read(bucket * fragsz_, frame, winsz_);
+    ApplyWindow(frame, rin, in);
+}
+
+void FFTChannel::ApplyWindow(float* frame, float* rin,
+                              fftwf_complex* in) const {
+    int w = std::min(winsz_, fftsz_);
+    if (rin) {
+        sound::vector::Mul(rin, frame, window_, w);
+        std::fill(rin + w, rin + fftsz_, 0.0f);
+    } else {
+        sound::vector::Mul(frame, frame, window_, w);
         for(int i=0; i<fftsz_; ++i) {
-            in_[i][0] = Windowed(channel.sample(s + i), i);
-            in_[i][1] = 0;
+            in[i][0] = i < w ? frame[i] : 0.0f;
+            in[i][1] = 0;
         }
-        s += fragsz_;
-        fftwf_execute(plan_);
-        auto f = absl::make_unique<Fragment>(fftsz_);
-        double scale = 1.0 / double(fftsz_);
-        for(int i=0; i<fftsz_; ++i) {
-//            (*f)[i][0] = out_[i][0] * scale;
-//            (*f)[i][1] = out_[i][1] * scale;
-            (*f)[i][0] = out_[i][0] * scale - (*correlation_)[i][0];
-            (*f)[i][1] = out_[i][1] * scale - (*correlation_)[i][1];
+    }
+}
+
+void FFTChannel::Forward(float* frame, float* rin, fftwf_complex* in,
+                         fftwf_complex* out) const {
+    ApplyWindow(frame, rin, in);
+    if (rin) {
+        fftwf_execute_dft_r2c(plan_, rin, out);
+    } else {
+        fftwf_execute_dft(plan_, in, out);
+    }
+    sound::vector::ScaleSub(&out[0][0], &out[0][0], 1.0f / float(fftsz_),
+                            &correlation_[0][0], 2 * bins_);
+}
+
+void FFTChannel::Compute(const sound::Channel& channel, size_t bucket,
+                          float* frame, float* rin, fftwf_complex* in,
+                          fftwf_complex* out) const {
+    Gather(channel, bucket, frame, rin, in);
+    // The plan was made for the member buffers; the new-array execute
+    // functions run it on any other buffers with the same alignment and
+    // are safe to call from several threads at once.
+    if (rin) {
+        fftwf_execute_dft_r2c(plan_, rin, out);
+    } else {
+        fftwf_execute_dft(plan_, in, out);
+    }
+}
+
+size_t FFTChannel::fragments(const sound::Channel& channel) const {
+    size_t samples = channel.length() * channel.rate();
+    return (samples + fragsz_ - 1) / fragsz_;
+}
+
+void FFTChannel::Sweep(const sound::Channel& channel, const SweepFn& fn,
+                       const std::atomic<bool>* cancel) const {
+    Sweep(channel, 0, fragments(channel), fn, cancel);
+}
+
+void FFTChannel::Sweep(const sound::Channel& channel, size_t begin,
+                       size_t end, const SweepFn& fn,
+                       const std::atomic<bool>* cancel) const {
+    end = std::min(end, fragments(channel));
+    std::vector<float> frame(winsz_);
+    std::vector<float> db(bins_);
+    bool real = transform_ == Transform::REAL;
+    float* rin = real ? fftwf_alloc_real(fftsz_) : nullptr;
+    fftwf_complex* in = real ? nullptr : fftwf_alloc_complex(fftsz_);
+    fftwf_complex* out = fftwf_alloc_complex(bins_);
+    const float scale = 1.0f / float(fftsz_);
+    for(size_t n=begin; n<end && !(cancel && *cancel); ++n) {
+        Compute(channel, n, frame.data(), rin, in, out);
+        sound::vector::ScaleSub(&out[0][0], &out[0][0], scale,
+                                &correlation_[0][0], 2 * bins_);
+        FrameStore::ToPolar(out, bins_, db.data(), nullptr);
+        fn(n, out, db.data());
+    }
+    fftwf_free(rin);
+    fftwf_free(in);
+    fftwf_free(out);
+}
+
+void FFTChannel::Finish(size_t n, fftwf_complex* out) {
+    // The bins are treated as 2*bins floats.
+    const float scale = 1.0f / float(fftsz_);
+    if (cache_.format() == FrameStore::Format::COMPLEX &&
+        cache_.layout() == FrameStore::Layout::TIME_MAJOR) {
+        // Frames are contiguous, so write straight into the store.
+        sound::vector::ScaleSub(&cache_.at(n, 0)[0], &out[0][0], scale,
+                                &correlation_[0][0], 2 * bins_);
+        return;
+    }
+    sound::vector::ScaleSub(&out[0][0], &out[0][0], scale,
+                            &correlation_[0][0], 2 * bins_);
+    cache_.Put(n, out);
+}
+
+long FFTChannel::Index(size_t n) const {
+    if (lazy_) {
+        return n < slot_of_.size() ? slot_of_[n] : -1;
+    }
+    return n < ready_ ? long(n) : -1;
+}
+
+float FFTChannel::PowerDb(size_t n, size_t bin) const {
+    std::unique_lock<std::mutex> lock(lazy_mu_, std::defer_lock);
+    if (lazy_) lock.lock();
+    long i = Index(n);
+    if (i < 0 || bin >= size_t(bins_)) {
+        return -std::numeric_limits<float>::infinity();
+    }
+    return cache_.db(i, bin);
+}
+
+bool FFTChannel::PowerDb(size_t n, float* db, size_t count) const {
+    std::unique_lock<std::mutex> lock(lazy_mu_, std::defer_lock);
+    if (lazy_) lock.lock();
+    long i = Index(n);
+    size_t b = 0;
+    if (i >= 0) {
+        for(; b<count && b<size_t(bins_); ++b) {
+            db[b] = cache_.db(i, b);
         }
-        cache_.emplace_back(std::move(f));
+    }
+    for(; b<count; ++b) {
+        db[b] = -std::numeric_limits<float>::infinity();
+    }
+    return i >= 0;
+}
+
+float FFTChannel::Phase(size_t n, size_t bin) const {
+    std::unique_lock<std::mutex> lock(lazy_mu_, std::defer_lock);
+    if (lazy_) lock.lock();
+    long i = Index(n);
+    if (i < 0 || bin >= size_t(bins_)) return 0;
+    return cache_.phase(i, bin);
+}
+
+void FFTChannel::Publish(int chunk, int chunks, int buckets) {
+    std::lock_guard<std::mutex> lock(publish_mu_);
+    chunk_done_[chunk] = true;
+    while(chunk_ready_ < chunks && chunk_done_[chunk_ready_]) {
+        ++chunk_ready_;
+    }
+    ready_ = std::min(chunk_ready_ * kChunkBuckets, buckets);
+}
+
+void FFTChannel::AnalyzeWorker(const sound::Channel& channel, int buckets,
+                               const std::atomic<bool>* cancel) {
+    // Each worker gathers up to |batch| windowed frames into one block
+    // and transforms them together.
+    std::vector<float> frame(winsz_);
+    int batch = batch_plan_ ? batch_ : 1;
+    bool real = transform_ == Transform::REAL;
+    float* rin = real ? fftwf_alloc_real(batch * fftsz_) : nullptr;
+    fftwf_complex* in = real ? nullptr : fftwf_alloc_complex(batch * fftsz_);
+    fftwf_complex* out = fftwf_alloc_complex(batch * bins_);
+    int chunks = (buckets + kChunkBuckets - 1) / kChunkBuckets;
+    for(;;) {
+        int chunk = next_chunk_++;
+        if (chunk >= chunks) break;
+        int end = std::min((chunk + 1) * kChunkBuckets, buckets);
+        bool cancelled = false;
+        for(int b=chunk * kChunkBuckets; b<end && !cancelled; b+=batch) {
+            int count = std::min(batch, end - b);
+            if (batch == 1) {
+                Compute(channel, b, frame.data(), rin, in, out);
+            } else {
+                // A short final batch leaves stale frames at the end of
+                // the block; their output is simply not stored.
+                for(int k=0; k<count; ++k) {
+                    Gather(channel, b + k, frame.data(),
+                           rin ? rin + k * fftsz_ : nullptr,
+                           in ? in + k * fftsz_ : nullptr);
+                }
+                if (rin) {
+                    fftwf_execute_dft_r2c(batch_plan_, rin, out);
+                } else {
+                    fftwf_execute_dft(batch_plan_, in, out);
+                }
+            }
+            for(int k=0; k<count; ++k) {
+                Finish(b + k, out + k * bins_);
+            }
+            cancelled = cancel && *cancel;
+        }
+        // A partially computed chunk is never published.
+        if (cancelled) break;
+        Publish(chunk, chunks, buckets);
+    }
+    fftwf_free(rin);
+    fftwf_free(in);
+    fftwf_free(out);
+}
+
+void FFTChannel::Analyze(const sound::Channel& channel,
+                         const std::atomic<bool>* cancel) {
+    StopLazy();
+    ready_ = 0;
+    length_ = channel.length();
+    rate_ = channel.rate();
+    MakeAdvance();
+    int buckets = fragments(channel);
+    // Size the store up front so readers never see it reallocate, and so
+    // each worker writes only its own preassigned frames.
+    cache_.Reset(buckets, bins_, layout_, storage_);
+    total_ = buckets;
+
+    int chunks = (buckets + kChunkBuckets - 1) / kChunkBuckets;
+    next_chunk_ = 0;
+    chunk_ready_ = 0;
+    chunk_done_.assign(chunks, false);
+
+    int threads = threads_;
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max(1, std::min(threads, chunks));
+    std::vector<std::thread> workers;
+    for(int t=1; t<threads; ++t) {
+        workers.emplace_back(&FFTChannel::AnalyzeWorker, this,
+                             std::cref(channel), buckets, cancel);
+    }
+    AnalyzeWorker(channel, buckets, cancel);
+    for(auto& w : workers) {
+        w.join();
     }
 }
 
@@ -1,20 +1,53 @@
 #ifndef WVLX_AUDIO_FFT_CHANNEL_H
 #define WVLX_AUDIO_FFT_CHANNEL_H
+#include <atomic>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <limits>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 #include <fftw3.h>
+#include "audio/frame_store.h"
 #include "util/sound/file.h"
 
 namespace audio {
 class FFTChannel {
   public:
-    using Fragment = std::vector<fftwf_complex>;
+    // KAISER and GAUSSIAN take a shape parameter; see SetWindow.
     enum WindowFn {
         RECTANGULAR = 0,
         BLACKMAN = 1,
+        HANN = 2,
+        HAMMING = 3,
+        BLACKMAN_HARRIS = 4,
+        FLAT_TOP = 5,
+        KAISER = 6,
+        GAUSSIAN = 7,
+    };
+    // COMPLEX keeps all fftsz bins of a complex transform.  REAL uses a
+    // real-input transform and keeps only the fftsz/2+1 unique bins, which
+    // is all the displays use, in about half the time and memory.
+    enum Transform {
+        COMPLEX = 0,
+        REAL = 1,
+    };
+    // How hard FFTW searches for a fast plan.  Anything above ESTIMATE
+    // runs trial transforms the first time a size is planned; the result
+    // is kept as FFTW wisdom under os::path::DataPath so later runs plan
+    // instantly.
+    enum Effort {
+        ESTIMATE = 0,
+        MEASURE = 1,
+        PATIENT = 2,
+        EXHAUSTIVE = 3,
     };
 
     FFTChannel(int n, int w=0)
@@ -25,47 +58,242 @@ class FFTChannel {
     FFTChannel() : FFTChannel(1024) {}
     ~FFTChannel();
 
-    void Init(int n, int w=0, WindowFn wf=WindowFn::RECTANGULAR);
-    void Analyze(const sound::Channel& channel);
+    void Init(int n, int w=0, WindowFn wf=WindowFn::RECTANGULAR,
+              Transform tf=Transform::COMPLEX);
+    // Loads or saves FFTW wisdom from WisdomFile().  Init loads it when
+    // planning with more than ESTIMATE effort, and saves it when that
+    // planning had to measure something the wisdom didn't cover.
+    static bool LoadWisdom();
+    static bool SaveWisdom();
+    static std::string WisdomFile();
+    // FFTW's planner is not thread-safe; anything else that makes or
+    // destroys plans holds this while it does.
+    static std::mutex& planner_mutex();
+
+    // Changes the window function.  |param| is beta for KAISER (default
+    // 8.6) and sigma, relative to half the window, for GAUSSIAN (default
+    // 0.4).  Takes effect on the next Analyze.
+    void SetWindow(WindowFn wf, double param=0);
+    // Computes every fragment of |channel|, spread across threads() worker
+    // threads.  Fragments are published in order as they complete, so
+    // another thread may read the first size() of them while analysis is
+    // still running.  Stops early if |cancel| becomes true.
+    void Analyze(const sound::Channel& channel,
+                 const std::atomic<bool>* cancel=nullptr);
+
+    // The number of fragments Analyze would compute for |channel|.
+    size_t fragments(const sound::Channel& channel) const;
+    // Computes every fragment of |channel| in order on the calling thread
+    // and passes its bins() bins and their power in dB to |fn|, without
+    // storing anything.  Stops early if |cancel| becomes true.
+    using SweepFn = std::function<void(size_t n, const fftwf_complex* bins,
+                                       const float* db)>;
+    void Sweep(const sound::Channel& channel, const SweepFn& fn,
+               const std::atomic<bool>* cancel=nullptr) const;
+    // Sweeps only fragments [begin, end).  Sweeps share no state, so
+    // several threads may each sweep their own range at once.
+    void Sweep(const sound::Channel& channel, size_t begin, size_t end,
+               const SweepFn& fn,
+               const std::atomic<bool>* cancel=nullptr) const;
+    // Windows the winsz() samples at |frame| and transforms them into the
+    // bins() bins of |out|, exactly as Analyze computes a fragment.  For
+    // a REAL transform |rin| is fftsz() floats of scratch, otherwise |in|
+    // is fftsz() complex; either must come from fftwf_alloc_*, and
+    // |frame| is overwritten.  Safe to call from several threads.
+    void Forward(float* frame, float* rin, fftwf_complex* in,
+                 fftwf_complex* out) const;
+    // Uses |frames| previously computed fragments of a channel of |rate|
+    // and |length| instead of analyzing.  |data| holds them time-major in
+    // the storage() format and is owned by |backing|.
+    void Adopt(std::shared_ptr<const void> backing, const void* data,
+               size_t frames, double rate, double length);
+
+    // Switches to on-demand analysis of |channel|.  Nothing is computed
+    // until Request asks for it, and at most cache_frames() fragments are
+    // kept, evicting the least recently used.
+    void Attach(std::shared_ptr<const sound::Channel> channel);
+    // In on-demand mode, asks for the fragments under |count| columns
+    // |dt| seconds apart starting at |t0|, then for the next screenful in
+    // the direction the view is moving.  They are computed on a background
+    // thread; until then ready(n) is false and fft(n) is zeros.  A view
+    // returned by fft() for a requested fragment stays valid until the
+    // next Request.
+    void Request(double t0, double dt, int count);
 
-    const Fragment* at(double tm) const {
+    FrameSpan at(double tm) const {
         size_t n = size_t(tm * rate_) / fragsz_;
         return fft(n);
     }
-    const Fragment* fft(size_t n) const {
-        return n < cache_.size() ? cache_.at(n).get()
-                                 : empty_.get();
-    }
+    // A view of fragment |n|, or of zeros if it is not computed yet.  Only
+    // a COMPLEX storage() format keeps the bins; use PowerDb and Phase to
+    // read any format.
+    FrameSpan fft(size_t n) const;
+    bool ready(size_t n) const;
+    // The power in dB of |bin| of fragment |n|, or -infinity if it is not
+    // computed yet.
+    float PowerDb(size_t n, size_t bin) const;
+    // Fills |db| with the power of the first |count| bins of fragment |n|.
+    // Returns false, filling with -infinity, if it is not computed yet.
+    bool PowerDb(size_t n, float* db, size_t count) const;
+    // The phase of |bin| of fragment |n|; 0 if the storage has no phase.
+    float Phase(size_t n, size_t bin) const;
+    // The power in dB and instantaneous frequency in Hz of every bin of
+    // fragments [n, n+frames), frame after frame in |db| and |freq|.  The
+    // frequency comes from each bin's phase advance since the previous
+    // fragment; without phase, or without that fragment, it is the bin's
+    // center.  Fragments not computed yet read as -infinity.  Returns the
+    // number that were computed.
+    size_t InstantFrequency(size_t n, size_t frames, float* db,
+                            float* freq) const;
+    // The same estimate for one fragment from its phases and those of the
+    // fragment before it, e.g. as given by FrameStore::ToPolar in a Sweep.
+    // Valid after Analyze, Attach or Adopt.
+    void InstantFrequency(const float* phase, const float* prev,
+                          float* freq) const;
 
     std::pair<float, float> MagnitudeAt(double tm, size_t bin) const;
 
     inline int fftsz() const { return fftsz_; }
+    // The number of bins stored in each fragment.
+    inline int bins() const { return bins_; }
+    inline Transform transform() const { return transform_; }
+    inline WindowFn window_fn() const { return winfn_; }
+    // The planner effort used by the next Init.
+    inline Effort effort() const { return effort_; }
+    inline void set_effort(Effort e) { effort_ = e; }
+    // The winsz() window coefficients.
+    inline const float* window() const { return window_; }
+    // The bins() bins subtracted from every fragment.
+    inline const fftwf_complex* correlation() const {
+        return correlation_.data();
+    }
     inline int winsz() const { return winsz_; }
     inline int fragsz() const { return fragsz_; }
     inline double rate() const { return rate_; }
     inline double length() const { return length_; }
-    inline size_t size() const { return cache_.size(); }
+    // The number of fragments computed so far, or in on-demand mode, the
+    // number that may be requested.
+    inline size_t size() const { return lazy_ ? total_ : ready_; }
+    inline double progress() const {
+        size_t total = total_;
+        if (lazy_) return 1.0;
+        return total ? double(ready_) / double(total) : 0.0;
+    }
+    inline bool lazy() const { return lazy_; }
 
     inline void set_fragsz(int f) { fragsz_ = f; }
+    // The number of analysis threads; 0 uses every hardware thread.
+    inline int threads() const { return threads_; }
+    inline void set_threads(int t) { threads_ = t; }
+    // The layout used by the next Analyze.
+    inline FrameStore::Layout layout() const { return layout_; }
+    inline void set_layout(FrameStore::Layout l) { layout_ = l; }
+    inline const FrameStore& store() const { return cache_; }
+    // How fragments are stored by the next Analyze or Attach.  DB is a
+    // quarter the size of COMPLEX; DB_PHASE, half.  MagnitudeAt needs
+    // phase to estimate frequency.
+    inline FrameStore::Format storage() const { return storage_; }
+    inline void set_storage(FrameStore::Format f) { storage_ = f; }
+    // The most fragments kept in on-demand mode; used by the next Attach.
+    inline size_t cache_frames() const { return cache_frames_; }
+    inline void set_cache_frames(size_t n) { cache_frames_ = n; }
+    // Frames transformed together by one batched plan in Analyze; 1
+    // transforms each frame on its own.  Used by the next Init.  The
+    // default of 16 amortizes each execute while keeping a batch's input
+    // (256 KiB of floats at fftsz 4096) within a typical per-core L2;
+    // batch_bench times the alternatives on a given machine.
+    inline int batch() const { return batch_; }
+    inline void set_batch(int b) { batch_ = b < 1 ? 1 : b; }
 
   private:
+    void Free();
+    // Destroys the plans; the caller holds planner_mutex().
+    void DestroyPlans();
+    void FreeArrays();
     void MakeCorrelation();
-    float Rectangular(float n);
-    float Blackman(float n);
-    float Windowed(float samp, int wpos);
+    // Builds advance_ and centers_ for the current fragsz_ and rate_.
+    void MakeAdvance();
+    // Reads and windows one frame into |rin| (REAL) or |in| (COMPLEX);
+    // the other is unused.
+    void Gather(const sound::Channel& channel, size_t bucket, float* frame,
+                float* rin, fftwf_complex* in) const;
+    // Applies the window to |frame| and copies it into |rin| or |in|.
+    void ApplyWindow(float* frame, float* rin, fftwf_complex* in) const;
+    // Transforms one frame, leaving the raw result in |out|.
+    void Compute(const sound::Channel& channel, size_t bucket, float* frame,
+                 float* rin, fftwf_complex* in, fftwf_complex* out) const;
+    // Scales the raw transform |out|, subtracts the correlation, and
+    // stores the result as frame |n| of cache_.  May overwrite |out|.
+    void Finish(size_t n, fftwf_complex* out);
+    // The frame of cache_ holding fragment |n|, or -1.  In on-demand mode
+    // the caller holds lazy_mu_.
+    long Index(size_t n) const;
+    void AnalyzeWorker(const sound::Channel& channel, int buckets,
+                       const std::atomic<bool>* cancel);
+    void Publish(int chunk, int chunks, int buckets);
+    void StopLazy();
+    void LazyWorker();
+    int Evict();
 
     int fftsz_;
     int winsz_;
     int fragsz_;
     WindowFn winfn_;
-    fftwf_plan plan_;
+    Transform transform_ = Transform::COMPLEX;
+    int bins_ = 0;
+    int threads_ = 0;
+    int batch_ = 16;
+    Effort effort_ = Effort::ESTIMATE;
+    FrameStore::Layout layout_ = FrameStore::Layout::TIME_MAJOR;
+    FrameStore::Format storage_ = FrameStore::Format::COMPLEX;
+    fftwf_plan plan_ = nullptr;
+    // Transforms batch_ frames laid out fftsz_ apart into bins_ apart.
+    fftwf_plan batch_plan_ = nullptr;
+    float *window_ = nullptr;
+    float *rin_ = nullptr;
     fftwf_complex *in_ = nullptr;
     fftwf_complex *out_ = nullptr;
     double rate_ = 0;
     double length_ = 0;
-    std::vector<std::unique_ptr<Fragment>> cache_;
-    std::unique_ptr<Fragment> empty_;
-    std::unique_ptr<Fragment> correlation_;
+    FrameStore cache_;
+    std::atomic<size_t> ready_{0};
+    std::atomic<size_t> total_{0};
+    // Work distribution for Analyze: the next chunk of buckets to claim,
+    // and which chunks are finished but not yet published.
+    std::atomic<int> next_chunk_{0};
+    std::mutex publish_mu_;
+    std::vector<bool> chunk_done_;
+    int chunk_ready_ = 0;
+
+    // On-demand mode.  cache_ holds cache_frames_ slots; slot_of_ maps
+    // fragments to slots and frag_of_slot_ maps back.  All of it is
+    // guarded by lazy_mu_.
+    static constexpr size_t kNoFragment = ~size_t(0);
+    std::atomic<bool> lazy_{false};
+    size_t cache_frames_ = 4096;
+    std::shared_ptr<const sound::Channel> source_;
+    mutable std::mutex lazy_mu_;
+    std::condition_variable lazy_cv_;
+    std::thread lazy_thread_;
+    bool stop_ = false;
+    std::vector<int> slot_of_;
+    std::vector<size_t> frag_of_slot_;
+    // A slot pinned in the current generation is showing and can't be
+    // evicted.  Each Request starts a new generation.
+    std::vector<uint64_t> pinned_;
+    uint64_t generation_ = 0;
+    std::list<int> lru_;
+    std::vector<std::list<int>::iterator> lru_pos_;
+    // Fragments still to compute, and whether each is visible.
+    std::deque<std::pair<size_t, bool>> pending_;
+    double last_t0_ = 0;
+    int direction_ = 0;
+    FrameStore empty_;
+    std::vector<fftwf_complex> correlation_;
+    // Per bin: the phase a sinusoid at the bin's center advances over one
+    // fragment, modulo 2*pi, and the center frequency in Hz.
+    std::vector<float> advance_;
+    std::vector<float> centers_;
 };
 }  // namespace
 
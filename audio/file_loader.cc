@@ -0,0 +1,140 @@
+#include "audio/file_loader.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util/logging.h"
+
+namespace audio {
+namespace {
+// The lowest constant-Q bin, C1.
+constexpr double kConstantQMin = 32.703;
+}  // namespace
+
+FileLoader::~FileLoader() {
+    Cancel();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void FileLoader::Start() {
+    thread_ = std::thread(&FileLoader::Run, this);
+}
+
+double FileLoader::progress() const {
+    switch(state_) {
+        case OPENING:
+            return 0.0;
+        case DECODING:
+            return 0.5 * file_->progress();
+        case ANALYZING:
+            return 0.5 + 0.5 * fft_.progress();
+        default:
+            return 1.0;
+    }
+}
+
+void FileLoader::Run() {
+    std::unique_ptr<sound::File> file;
+    if (mmap_) {
+        file = sound::File::Map(filename_);
+    }
+    if (!file) {
+        file = sound::File::Open(filename_, true);
+    }
+    if (!file) {
+        state_ = FAILED;
+        return;
+    }
+    file->channel(0)->set_interpolation(sound::Interpolation::Linear);
+    file_ = std::move(file);
+    state_ = DECODING;
+
+    while(!cancel_ && file_->Decode() > 0) {}
+    if (cancel_) {
+        state_ = CANCELLED;
+        return;
+    }
+
+    state_ = ANALYZING;
+    std::shared_ptr<sound::Channel> channel = file_->channel(0);
+    if (analysis_rate_ && analysis_rate_ != channel->rate()) {
+        channel = channel->Resample(analysis_rate_);
+    }
+    channel_ = channel;
+    // Size the pyramid and plan the constant-Q bins before anything can
+    // be drawn from them.
+    if (pyramid_) pyramid_->Reset(fft_.fragments(*channel), fft_.bins());
+    if (cqt_ && cqt_->Init(channel->rate(), kConstantQMin,
+                           channel->rate() / 2, cqt_bins_per_octave_,
+                           fft_.fragsz())) {
+        cqt_ready_ = cqt_.get();
+    }
+    AnalysisCache::Key key;
+    if (use_cache_) {
+        key = AnalysisCache::MakeKey(filename_, *channel, fft_);
+        if (AnalysisCache::Load(key, *channel, &fft_)) {
+            state_ = DONE;
+            LOG(INFO, "FileLoader: ", filename_, " loaded from cache");
+            AnalyzeConstantQ(*channel);
+            BuildPyramid(*channel, nullptr);
+            return;
+        }
+    }
+    if (lazy_) {
+        fft_.Attach(channel);
+        state_ = DONE;
+        LOG(INFO, "FileLoader: ", filename_, " loaded");
+        AnalyzeConstantQ(*channel);
+        // The background sweep sees every fragment, so it can fill the
+        // cache for next time as well as the pyramid.
+        std::unique_ptr<AnalysisCache::Writer> writer;
+        if (use_cache_) writer = AnalysisCache::Create(key, *channel, fft_);
+        BuildPyramid(*channel, writer.get());
+        if (writer && !cancel_) writer->Finish();
+        return;
+    }
+    fft_.Analyze(*channel, &cancel_);
+    if (!cancel_) {
+        if (use_cache_) AnalysisCache::Save(key, *channel, fft_);
+        BuildPyramid(*channel, nullptr);
+    }
+    state_ = cancel_ ? CANCELLED : DONE;
+    LOG(INFO, "FileLoader: ", filename_,
+        cancel_ ? " cancelled" : " loaded");
+    if (!cancel_) AnalyzeConstantQ(*channel);
+}
+
+void FileLoader::AnalyzeConstantQ(const sound::Channel& channel) {
+    if (!cqt_ready_) return;
+    cqt_->set_threads(fft_.threads());
+    cqt_->set_storage(fft_.storage());
+    cqt_->Analyze(channel, &cancel_);
+}
+
+void FileLoader::BuildPyramid(const sound::Channel& channel,
+                              AnalysisCache::Writer* writer) {
+    if (!pyramid_ && !writer) return;
+    size_t bins = fft_.bins();
+    if (fft_.lazy()) {
+        // Nothing is stored yet, so sweep the whole channel.
+        fft_.Sweep(channel, [this, writer](size_t n, const fftwf_complex* bins,
+                                           const float* db) {
+            if (pyramid_) pyramid_->Add(db);
+            if (writer) writer->Put(bins);
+        }, &cancel_);
+    } else if (pyramid_) {
+        // Stored frames only feed the pyramid.
+        std::vector<float> db(bins);
+        for(size_t n=0; n<fft_.size() && !cancel_; ++n) {
+            fft_.PowerDb(n, db.data(), bins);
+            pyramid_->Add(db.data());
+        }
+    }
+    if (pyramid_ && !cancel_) pyramid_->Finish();
+}
+
+}  // namespace audio
@@ -0,0 +1,116 @@
+#ifndef WVLX_AUDIO_FILE_LOADER_H
+#define WVLX_AUDIO_FILE_LOADER_H
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "absl/memory/memory.h"
+#include "audio/analysis_cache.h"
+#include "audio/cqt_channel.h"
+#include "audio/fft_channel.h"
+#include "audio/spectrum_pyramid.h"
+#include "util/sound/file.h"
+
+namespace audio {
+
+// Decodes a file as mono and analyzes it on a background thread, or
+// attaches it for on-demand analysis.  The
+// file and its FFT may be read from other threads while loading is in
+// progress: the decoded prefix of the channel and the first size()
+// fragments of the FFT are always valid.
+class FileLoader {
+  public:
+    enum State {
+        OPENING = 0,
+        DECODING,
+        ANALYZING,
+        DONE,
+        FAILED,
+        CANCELLED,
+    };
+
+    explicit FileLoader(const std::string& filename)
+      : filename_(filename) {}
+    // Cancels any work in progress and waits for the worker to exit.
+    ~FileLoader();
+
+    // Starts the worker.  Configure fft() before calling this.
+    void Start();
+    void Cancel() { cancel_ = true; }
+
+    inline State state() const { return state_; }
+    inline bool busy() const { return state_ < DONE; }
+    // Overall progress in [0, 1]; decoding and analysis each count half.
+    double progress() const;
+    inline const std::string& filename() const { return filename_; }
+
+    // Returns nullptr until the file has been opened.
+    inline sound::File* file() {
+        return state_ >= DECODING && state_ != FAILED ? file_.get() : nullptr;
+    }
+    inline FFTChannel* fft() { return &fft_; }
+    // The channel fft() analyzes, resampled if set_analysis_rate asked for
+    // it.  Valid once state() is DONE.
+    inline std::shared_ptr<const sound::Channel> analysis_channel() const {
+        return state_ == DONE ? channel_ : nullptr;
+    }
+    // The overview pyramid, or nullptr if it is disabled.  Its cells fill
+    // in after analysis, or in the background in on-demand mode.
+    inline const SpectrumPyramid* pyramid() const {
+        return pyramid_ ? pyramid_.get() : nullptr;
+    }
+    // Memory-map uncompressed WAV files instead of decoding them.
+    inline void set_mmap(bool m) { mmap_ = m; }
+    // If nonzero, analyze a copy of the channel resampled to |rate|.
+    inline void set_analysis_rate(double rate) { analysis_rate_ = rate; }
+    // Compute the FFT on demand for whatever is being viewed instead of
+    // analyzing the whole file up front.
+    inline void set_lazy(bool lazy) { lazy_ = lazy; }
+    // Reuse and save finished analyses with AnalysisCache.
+    inline void set_cache(bool c) { use_cache_ = c; }
+    // Builds an overview pyramid pooled with |pool|.
+    inline void set_pyramid(SpectrumPyramid::Pool pool) {
+        pyramid_ = absl::make_unique<SpectrumPyramid>(pool);
+    }
+    // Also computes a constant-Q transform with |bins_per_octave| bins to
+    // the octave, once the FFT is available, stored like fft().  Call
+    // before Start.
+    inline void set_constant_q(int bins_per_octave) {
+        cqt_bins_per_octave_ = bins_per_octave;
+        cqt_ = absl::make_unique<CQTChannel>();
+    }
+    // The constant-Q transform, or nullptr if it is disabled or not yet
+    // planned.  It is published once its bins are planned, before fft()
+    // has any fragments, and never withdrawn.
+    inline const CQTChannel* cqt() const { return cqt_ready_; }
+
+  private:
+    void Run();
+    // Fills the pyramid, and in on-demand mode |writer|, if either is set.
+    void BuildPyramid(const sound::Channel& channel,
+                      AnalysisCache::Writer* writer);
+    // Runs the constant-Q analysis, if it is enabled.
+    void AnalyzeConstantQ(const sound::Channel& channel);
+
+    std::string filename_;
+    bool mmap_ = false;
+    double analysis_rate_ = 0;
+    bool lazy_ = false;
+    bool use_cache_ = false;
+    std::unique_ptr<sound::File> file_;
+    std::shared_ptr<const sound::Channel> channel_;
+    FFTChannel fft_;
+    std::unique_ptr<SpectrumPyramid> pyramid_;
+    int cqt_bins_per_octave_ = 0;
+    // Owned by the worker until Init succeeds and it is published in
+    // cqt_ready_; only set_constant_q, before Start, replaces it.
+    std::unique_ptr<CQTChannel> cqt_;
+    std::atomic<const CQTChannel*> cqt_ready_{nullptr};
+    std::thread thread_;
+    std::atomic<State> state_{OPENING};
+    std::atomic<bool> cancel_{false};
+};
+
+}  // namespace audio
+#endif // WVLX_AUDIO_FILE_LOADER_H
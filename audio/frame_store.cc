@@ -0,0 +1,218 @@
+#include "audio/frame_store.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "util/sound/sample.h"
+#include "util/sound/vector.h"
+
+namespace audio {
+namespace {
+// The quantized dB range.  Code 0 is reserved for anything below kDbMin,
+// which reads back as -infinity; the rest step about 0.004 dB.
+constexpr float kDbMin = -180.0f;
+constexpr float kDbMax = 60.0f;
+constexpr float kDbStep = (kDbMax - kDbMin) / 65534.0f;
+
+uint16_t QuantizeDb(float db) {
+    if (!(db > kDbMin)) return 0;
+    if (db >= kDbMax) return 65535;
+    return uint16_t(1.0f + (db - kDbMin) / kDbStep + 0.5f);
+}
+
+float DequantizeDb(uint16_t q) {
+    return q ? kDbMin + float(q - 1) * kDbStep
+             : -std::numeric_limits<float>::infinity();
+}
+
+float Db(const fftwf_complex& x) {
+    return 20.0f * log10f(2.0f * sqrtf(x[0]*x[0] + x[1]*x[1]));
+}
+
+// Bins converted per pass by ToPolar and Put, sized to keep the scratch
+// arrays on the stack.
+constexpr size_t kPolarChunk = 256;
+}  // namespace
+
+void FrameStore::ToPolar(const fftwf_complex* bins, size_t count,
+                         float* db, float* phase) {
+    float re[kPolarChunk], im[kPolarChunk];
+    for(size_t i=0; i<count; i+=kPolarChunk) {
+        size_t n = std::min(kPolarChunk, count - i);
+        sound::vector::Deinterleave(re, im, &bins[i][0], n);
+        if (phase) sound::vector::Atan2(phase + i, im, re, n);
+        // 20*log10(2*|x|) == 10*log10(4*|x|^2)
+        sound::vector::Norm(re, re, im, n);
+        sound::vector::Scale(re, re, 4.0f, n);
+        sound::vector::Log10(db + i, re, n);
+        sound::vector::Scale(db + i, db + i, 10.0f, n);
+    }
+}
+
+FrameStore::~FrameStore() {
+    Free();
+}
+
+void FrameStore::Free() {
+    if (!backing_) {
+        fftwf_free(data_);
+        fftwf_free(packed_);
+    }
+    backing_.reset();
+    data_ = nullptr;
+    packed_ = nullptr;
+}
+
+size_t FrameStore::BinSize(Format format) {
+    switch(format) {
+        case Format::COMPLEX: return sizeof(fftwf_complex);
+        case Format::DB: return sizeof(uint16_t);
+        case Format::DB_PHASE: return 2 * sizeof(uint16_t);
+    }
+    return sizeof(fftwf_complex);
+}
+
+void FrameStore::Reset(size_t frames, size_t bins, Layout layout,
+                       Format format) {
+    Free();
+    frames_ = frames;
+    bins_ = bins;
+    layout_ = layout;
+    format_ = format;
+    if (!memory()) return;
+    // fftwf_malloc returns memory aligned for the widest SIMD FFTW uses.
+    void* mem = fftwf_malloc(memory());
+    memset(mem, 0, memory());
+    if (format_ == Format::COMPLEX) {
+        data_ = static_cast<fftwf_complex*>(mem);
+    } else {
+        packed_ = static_cast<uint16_t*>(mem);
+    }
+}
+
+void FrameStore::Adopt(std::shared_ptr<const void> backing, const void* data,
+                       size_t frames, size_t bins, Layout layout,
+                       Format format) {
+    Free();
+    backing_ = backing;
+    frames_ = frames;
+    bins_ = bins;
+    layout_ = layout;
+    format_ = format;
+    // The view is only ever read; the casts just let it share the members
+    // of an owned store.
+    void* mem = const_cast<void*>(data);
+    if (format_ == Format::COMPLEX) {
+        data_ = static_cast<fftwf_complex*>(mem);
+    } else {
+        packed_ = static_cast<uint16_t*>(mem);
+    }
+}
+
+void FrameStore::Put(size_t n, const fftwf_complex* bins) {
+    switch(format_) {
+        case Format::COMPLEX:
+            for(size_t b=0; b<bins_; ++b) {
+                fftwf_complex& x = at(n, b);
+                x[0] = bins[b][0];
+                x[1] = bins[b][1];
+            }
+            break;
+        case Format::DB:
+        case Format::DB_PHASE: {
+            float db[kPolarChunk], phase[kPolarChunk];
+            bool keep = has_phase();
+            for(size_t b=0; b<bins_; b+=kPolarChunk) {
+                size_t count = std::min(kPolarChunk, bins_ - b);
+                ToPolar(bins + b, count, db, keep ? phase : nullptr);
+                for(size_t i=0; i<count; ++i) {
+                    size_t k = Index(n, b + i);
+                    if (keep) {
+                        packed_[2 * k] = QuantizeDb(db[i]);
+                        packed_[2 * k + 1] = sound::FloatToHalf(phase[i]);
+                    } else {
+                        packed_[k] = QuantizeDb(db[i]);
+                    }
+                }
+            }
+            break;
+        }
+    }
+}
+
+void FrameStore::PutDb(size_t n, const float* db, const float* phase) {
+    for(size_t b=0; b<bins_; ++b) {
+        switch(format_) {
+            case Format::COMPLEX: {
+                fftwf_complex& x = at(n, b);
+                float mag = 0.5f * powf(10.0f, db[b] / 20.0f);
+                float ph = phase ? phase[b] : 0.0f;
+                x[0] = mag * cosf(ph);
+                x[1] = mag * sinf(ph);
+                break;
+            }
+            case Format::DB:
+                packed_[Index(n, b)] = QuantizeDb(db[b]);
+                break;
+            case Format::DB_PHASE:
+                packed_[2 * Index(n, b)] = QuantizeDb(db[b]);
+                packed_[2 * Index(n, b) + 1] =
+                    phase ? sound::FloatToHalf(phase[b]) : 0;
+                break;
+        }
+    }
+}
+
+float FrameStore::db(size_t n, size_t b) const {
+    switch(format_) {
+        case Format::COMPLEX:
+            return Db(data_[Index(n, b)]);
+        case Format::DB:
+            return DequantizeDb(packed_[Index(n, b)]);
+        case Format::DB_PHASE:
+            return DequantizeDb(packed_[2 * Index(n, b)]);
+    }
+    return 0;
+}
+
+float FrameStore::phase(size_t n, size_t b) const {
+    switch(format_) {
+        case Format::COMPLEX: {
+            const fftwf_complex& x = data_[Index(n, b)];
+            return atan2f(x[1], x[0]);
+        }
+        case Format::DB:
+            return 0;
+        case Format::DB_PHASE:
+            return sound::HalfToFloat(packed_[2 * Index(n, b) + 1]);
+    }
+    return 0;
+}
+
+void FrameStore::Polar(size_t n, float* db, float* phase) const {
+    if (format_ == Format::COMPLEX) {
+        if (layout_ == Layout::TIME_MAJOR) {
+            ToPolar(data_ + n * bins_, bins_, db, phase);
+            return;
+        }
+        // Gather the strided frame a chunk at a time.
+        fftwf_complex x[kPolarChunk];
+        for(size_t b=0; b<bins_; b+=kPolarChunk) {
+            size_t count = std::min(kPolarChunk, bins_ - b);
+            for(size_t i=0; i<count; ++i) {
+                x[i][0] = data_[Index(n, b + i)][0];
+                x[i][1] = data_[Index(n, b + i)][1];
+            }
+            ToPolar(x, count, db + b, phase ? phase + b : nullptr);
+        }
+        return;
+    }
+    for(size_t b=0; b<bins_; ++b) {
+        db[b] = this->db(n, b);
+        if (phase) phase[b] = this->phase(n, b);
+    }
+}
+
+}  // namespace audio
@@ -0,0 +1,138 @@
+#ifndef WVLX_AUDIO_FRAME_STORE_H
+#define WVLX_AUDIO_FRAME_STORE_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <fftw3.h>
+
+namespace audio {
+
+// A read-only view of one frame of spectrum bins.  Bins are |stride|
+// elements apart, so a frame of a bin-major store can be viewed in place.
+class FrameSpan {
+  public:
+    FrameSpan() {}
+    FrameSpan(const fftwf_complex* data, size_t size, size_t stride=1)
+      : data_(data), size_(size), stride_(stride) {}
+
+    inline const fftwf_complex& operator[](size_t i) const {
+        return data_[i * stride_];
+    }
+    inline const fftwf_complex& at(size_t i) const { return (*this)[i]; }
+    inline const fftwf_complex* data() const { return data_; }
+    inline size_t size() const { return size_; }
+    inline size_t stride() const { return stride_; }
+  private:
+    const fftwf_complex* data_ = nullptr;
+    size_t size_ = 0;
+    size_t stride_ = 1;
+};
+
+// A frames x bins array of spectrum bins in one SIMD-aligned allocation.
+class FrameStore {
+  public:
+    // TIME_MAJOR keeps each frame contiguous, which suits computing and
+    // drawing one frame at a time.  BIN_MAJOR keeps each bin's history
+    // contiguous, which suits scanning a bin across time.
+    enum Layout {
+        TIME_MAJOR = 0,
+        BIN_MAJOR = 1,
+    };
+    // COMPLEX keeps each bin as an fftwf_complex (8 bytes).  DB keeps only
+    // the power, quantized to a uint16 (2 bytes), and DB_PHASE adds the
+    // phase as a half float (4 bytes).  Only COMPLEX stores can be viewed
+    // with frame(), bin() and at().
+    enum Format {
+        COMPLEX = 0,
+        DB = 1,
+        DB_PHASE = 2,
+    };
+
+    FrameStore() {}
+    FrameStore(size_t frames, size_t bins, Layout layout=Layout::TIME_MAJOR,
+               Format format=Format::COMPLEX)
+      { Reset(frames, bins, layout, format); }
+    ~FrameStore();
+    FrameStore(const FrameStore&) = delete;
+    FrameStore& operator=(const FrameStore&) = delete;
+
+    // Reallocates the store and fills it with zeros.
+    void Reset(size_t frames, size_t bins,
+               Layout layout=Layout::TIME_MAJOR,
+               Format format=Format::COMPLEX);
+    // Makes the store a read-only view of |data|, which holds frames in
+    // the layout and format given and is owned by |backing|.  |data| must
+    // be aligned like fftwf_malloc memory.
+    void Adopt(std::shared_ptr<const void> backing, const void* data,
+               size_t frames, size_t bins, Layout layout, Format format);
+
+    inline FrameSpan frame(size_t n) const {
+        if (!data_) return FrameSpan();
+        return layout_ == Layout::TIME_MAJOR
+            ? FrameSpan(data_ + n * bins_, bins_, 1)
+            : FrameSpan(data_ + n, bins_, frames_);
+    }
+    // A view of one bin across every frame.
+    inline FrameSpan bin(size_t b) const {
+        if (!data_) return FrameSpan();
+        return layout_ == Layout::TIME_MAJOR
+            ? FrameSpan(data_ + b, frames_, bins_)
+            : FrameSpan(data_ + b * frames_, frames_, 1);
+    }
+    inline fftwf_complex& at(size_t n, size_t b) {
+        return data_[Index(n, b)];
+    }
+
+    // Stores |bins()| complex bins as frame |n|, in any format.
+    void Put(size_t n, const fftwf_complex* bins);
+    // Stores the power of |bins()| bins, in dB, as frame |n|, with their
+    // phase if |phase| is given and the format keeps it, else zero.
+    void PutDb(size_t n, const float* db, const float* phase=nullptr);
+    // The power of bin |b| of frame |n| in dB, 20*log10(2*|x|).
+    float db(size_t n, size_t b) const;
+    // The phase of bin |b| of frame |n|, or 0 for a DB store.
+    float phase(size_t n, size_t b) const;
+    // Fills |db| and, if non-null, |phase| with all bins of frame |n|.
+    void Polar(size_t n, float* db, float* phase) const;
+
+    // Converts |count| complex bins to power in dB and, if |phase| is
+    // non-null, phase.  Uses the vector approximations, so it is cheap
+    // enough to run on every frame of an analysis.
+    static void ToPolar(const fftwf_complex* bins, size_t count, float* db,
+                        float* phase);
+
+    inline size_t frames() const { return frames_; }
+    inline size_t bins() const { return bins_; }
+    inline Layout layout() const { return layout_; }
+    inline Format format() const { return format_; }
+    inline bool has_phase() const { return format_ != Format::DB; }
+    // The memory() bytes of the store, e.g. to save it.
+    inline const void* raw() const {
+        return data_ ? static_cast<const void*>(data_) : packed_;
+    }
+    // Bytes held by the store.
+    inline size_t memory() const {
+        return frames_ * bins_ * BinSize(format_);
+    }
+    static size_t BinSize(Format format);
+  private:
+    inline size_t Index(size_t n, size_t b) const {
+        return layout_ == Layout::TIME_MAJOR ? n * bins_ + b
+                                             : b * frames_ + n;
+    }
+
+    void Free();
+
+    // Set when the store views memory it doesn't own.
+    std::shared_ptr<const void> backing_;
+    fftwf_complex* data_ = nullptr;
+    // DB and DB_PHASE stores: one or two uint16s per bin.
+    uint16_t* packed_ = nullptr;
+    size_t frames_ = 0;
+    size_t bins_ = 0;
+    Layout layout_ = Layout::TIME_MAJOR;
+    Format format_ = Format::COMPLEX;
+};
+
+}  // namespace audio
+#endif // WVLX_AUDIO_FRAME_STORE_H
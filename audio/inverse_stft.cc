@@ -0,0 +1,115 @@
+#include "audio/inverse_stft.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#include "util/sound/vector.h"
+
+namespace audio {
+namespace {
+// The weight floor, relative to the largest summed squared window where
+// frames overlap fully.
+constexpr float kMinWeight = 1e-6f;
+}  // namespace
+
+InverseSTFT::InverseSTFT(const FFTChannel& fft)
+  : real_(fft.transform() == FFTChannel::Transform::REAL),
+  fftsz_(fft.fftsz()),
+  winsz_(std::min(fft.winsz(), fft.fftsz())),
+  fragsz_(fft.fragsz()),
+  bins_(fft.bins()),
+  window_(fft.window(), fft.window() + winsz_),
+  window2_(winsz_),
+  correlation_(&fft.correlation()[0][0],
+               &fft.correlation()[0][0] + 2 * bins_),
+  frame_(winsz_),
+  sum_(winsz_),
+  weight_(winsz_) {
+    sound::vector::Mul(window2_.data(), window_.data(), window_.data(),
+                       winsz_);
+    float steady = 0;
+    for(int i=0; i<std::min(fragsz_, winsz_); ++i) {
+        float w = 0;
+        for(int j=i; j<winsz_; j+=fragsz_) w += window2_[j];
+        steady = std::max(steady, w);
+    }
+    floor_ = kMinWeight * steady;
+
+    // FFTChannel keeps the forward transform unnormalized but divides the
+    // bins by fftsz, so the unnormalized inverse returns the windowed
+    // samples exactly.
+    in_ = fftwf_alloc_complex(bins_);
+    std::lock_guard<std::mutex> lock(FFTChannel::planner_mutex());
+    if (real_) {
+        rout_ = fftwf_alloc_real(fftsz_);
+        plan_ = fftwf_plan_dft_c2r_1d(fftsz_, in_, rout_, FFTW_ESTIMATE);
+    } else {
+        out_ = fftwf_alloc_complex(fftsz_);
+        plan_ = fftwf_plan_dft_1d(fftsz_, in_, out_, FFTW_BACKWARD,
+                                  FFTW_ESTIMATE);
+    }
+}
+
+InverseSTFT::~InverseSTFT() {
+    {
+        std::lock_guard<std::mutex> lock(FFTChannel::planner_mutex());
+        if (plan_) fftwf_destroy_plan(plan_);
+    }
+    fftwf_free(in_);
+    fftwf_free(rout_);
+    fftwf_free(out_);
+}
+
+void InverseSTFT::Push(const fftwf_complex* bins, float* out) {
+    // Add back the correlation FFTChannel subtracted.  The inverse
+    // overwrites its input, so work on a copy.
+    memcpy(in_, bins, bins_ * sizeof(fftwf_complex));
+    sound::vector::MulAdd(&in_[0][0], correlation_.data(), 1.0f, 2 * bins_);
+    if (real_) {
+        fftwf_execute(plan_);
+        std::copy(rout_, rout_ + winsz_, frame_.begin());
+    } else {
+        // An edited complex spectrum needn't be Hermitian; keep the real
+        // part, the nearest real signal.
+        fftwf_execute(plan_);
+        for(int i=0; i<winsz_; ++i) frame_[i] = out_[i][0];
+    }
+    // Samples past winsz are outside the window, so only time aliasing
+    // from edits lands there; they are dropped.
+    sound::vector::Mul(frame_.data(), frame_.data(), window_.data(), winsz_);
+    sound::vector::MulAdd(sum_.data(), frame_.data(), 1.0f, winsz_);
+    sound::vector::MulAdd(weight_.data(), window2_.data(), 1.0f, winsz_);
+    Emit(out, fragsz_);
+}
+
+void InverseSTFT::Flush(float* out) {
+    Emit(out, tail());
+    Reset();
+}
+
+void InverseSTFT::Reset() {
+    std::fill(sum_.begin(), sum_.end(), 0.0f);
+    std::fill(weight_.begin(), weight_.end(), 0.0f);
+    position_ = 0;
+}
+
+void InverseSTFT::Emit(float* out, int n) {
+    // When fragments are longer than the window, the gap between windows
+    // is silent.
+    int done = std::min(n, winsz_);
+    for(int i=0; i<done; ++i) {
+        float w = std::max(weight_[i], floor_);
+        out[i] = w > 0.0f ? sum_[i] / w : 0.0f;
+    }
+    std::fill(out + done, out + n, 0.0f);
+
+    int keep = winsz_ - done;
+    memmove(sum_.data(), sum_.data() + done, keep * sizeof(float));
+    memmove(weight_.data(), weight_.data() + done, keep * sizeof(float));
+    std::fill(sum_.begin() + keep, sum_.end(), 0.0f);
+    std::fill(weight_.begin() + keep, weight_.end(), 0.0f);
+    position_ += n;
+}
+
+}  // namespace audio
@@ -0,0 +1,75 @@
+#ifndef WVLX_AUDIO_INVERSE_STFT_H
+#define WVLX_AUDIO_INVERSE_STFT_H
+#include <cstddef>
+#include <vector>
+#include <fftw3.h>
+
+#include "audio/fft_channel.h"
+
+namespace audio {
+// Resynthesizes audio from the frames an FFTChannel produces, e.g. after
+// editing them.
+//
+// Each frame is inverse transformed, windowed again and overlap-added at
+// fragsz() spacing, then divided by the summed squared window.  This is
+// the least-squares inverse of the analysis: unmodified frames give back
+// the input to within float rounding, and edited ones give the signal
+// whose spectrogram is closest to them.  Frames are taken one at a time
+// and each completes the next fragsz() samples, so a whole file can be
+// streamed through in constant memory.
+class InverseSTFT {
+  public:
+    // Copies the transform, window, fragment size and correlation of
+    // |fft|, so later changes to it don't apply.
+    explicit InverseSTFT(const FFTChannel& fft);
+    ~InverseSTFT();
+
+    // Adds the bins() bins of the next frame, in the form FFTChannel
+    // stores and sweeps them, and writes the fragsz() samples it
+    // completes to |out|.  The first frame completes samples [0, fragsz).
+    void Push(const fftwf_complex* bins, float* out);
+    // Writes the tail() samples after the last frame's fragment, which no
+    // later frame overlaps, and starts over.
+    void Flush(float* out);
+    // Starts over without writing anything.
+    void Reset();
+
+    inline int bins() const { return bins_; }
+    inline int fftsz() const { return fftsz_; }
+    inline int fragsz() const { return fragsz_; }
+    // The samples Flush writes.
+    inline int tail() const { return winsz_ > fragsz_ ? winsz_ - fragsz_ : 0; }
+    // Samples written since the start.
+    inline size_t position() const { return position_; }
+
+  private:
+    // Writes |n| finished samples from the front of the accumulators and
+    // shifts them out.
+    void Emit(float* out, int n);
+
+    bool real_;
+    int fftsz_;
+    // The samples each frame covers: the window, truncated to fftsz.
+    int winsz_;
+    int fragsz_;
+    int bins_;
+    fftwf_plan plan_ = nullptr;
+    fftwf_complex* in_ = nullptr;
+    float* rout_ = nullptr;
+    fftwf_complex* out_ = nullptr;
+    std::vector<float> window_;
+    std::vector<float> window2_;
+    std::vector<float> correlation_;
+    std::vector<float> frame_;
+    // The windowed frames and squared windows summed so far, starting at
+    // sample position_.
+    std::vector<float> sum_;
+    std::vector<float> weight_;
+    // Weights below this are raised to it rather than amplifying the
+    // nearly silent ends of the first and last windows.
+    float floor_ = 0;
+    size_t position_ = 0;
+};
+
+}  // namespace audio
+#endif // WVLX_AUDIO_INVERSE_STFT_H
@@ -0,0 +1,88 @@
+// Checks that InverseSTFT undoes FFTChannel's analysis: sweeping a signal
+// and pushing the unmodified frames back gives the signal again, to float
+// rounding, wherever the frames fully overlap.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "audio/fft_channel.h"
+#include "audio/inverse_stft.h"
+#include "util/sound/file.h"
+
+namespace {
+constexpr double kRate = 8000;
+constexpr size_t kSamples = 8000;
+constexpr double kTolerance = 1e-6;
+
+struct Config {
+    int fftsz;
+    int winsz;
+    int fragsz;
+    audio::FFTChannel::WindowFn window;
+    audio::FFTChannel::Transform transform;
+};
+
+// Returns the largest error over the region every frame covers, or a
+// negative value if the output was the wrong length.
+double MaxError(const sound::Channel& channel, const Config& c) {
+    audio::FFTChannel fft;
+    fft.Init(c.fftsz, c.winsz, c.window, c.transform);
+    fft.set_fragsz(c.fragsz);
+    audio::InverseSTFT inv(fft);
+
+    std::vector<float> out, block(inv.fragsz());
+    fft.Sweep(channel, [&](size_t n, const fftwf_complex* bins,
+                           const float* db) {
+        inv.Push(bins, block.data());
+        out.insert(out.end(), block.begin(), block.end());
+    });
+    block.resize(inv.tail());
+    inv.Flush(block.data());
+    out.insert(out.end(), block.begin(), block.end());
+    if (out.size() < kSamples) return -1;
+
+    // A frame covers the window, truncated to the transform.
+    size_t edge = std::min(c.fftsz, c.winsz);
+    double err = 0;
+    for(size_t i=edge; i+edge<kSamples; ++i) {
+        err = std::max(err, std::fabs(double(out[i]) - channel.sample(i)));
+    }
+    return err;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    auto channel = std::make_shared<sound::Channel>(kSamples, kRate);
+    for(size_t i=0; i<kSamples; ++i) {
+        channel->data()[i] = 0.5f * std::sin(2 * M_PI * 440 * i / kRate) +
+                             0.3f * std::sin(2 * M_PI * 3000 * i / kRate) +
+                             0.05f * float(int(i * 7919 % 13) - 6) / 6.0f;
+    }
+
+    using FFT = audio::FFTChannel;
+    const Config configs[] = {
+        {256, 256, 64, FFT::WindowFn::HANN, FFT::Transform::REAL},
+        {256, 256, 128, FFT::WindowFn::BLACKMAN, FFT::Transform::COMPLEX},
+        {256, 200, 50, FFT::WindowFn::HAMMING, FFT::Transform::REAL},
+        {256, 200, 64, FFT::WindowFn::HANN, FFT::Transform::COMPLEX},
+        {128, 256, 32, FFT::WindowFn::HANN, FFT::Transform::REAL},
+        {128, 256, 50, FFT::WindowFn::BLACKMAN, FFT::Transform::COMPLEX},
+    };
+    bool ok = true;
+    for(const auto& c : configs) {
+        double err = MaxError(*channel, c);
+        printf("fftsz %d winsz %d fragsz %d %s: max error %g\n",
+               c.fftsz, c.winsz, c.fragsz,
+               c.transform == FFT::Transform::REAL ? "real" : "complex", err);
+        if (err < 0 || err > kTolerance) {
+            fprintf(stderr, "FAIL: reconstruction error above %g\n",
+                    kTolerance);
+            ok = false;
+        }
+    }
+    if (!ok) return 1;
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include "audio/mel_features.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "util/logging.h"
+#include "util/sound/sample.h"
+#include "util/sound/vector.h"
+
+namespace audio {
+namespace {
+constexpr double pi = 3.14159265358979323846264338327950288;
+// Frames claimed by a worker at a time.
+constexpr int kChunkFrames = 256;
+// Filter energies are floored here, -100 dB, before taking the log.
+constexpr float kMelFloor = 1e-10f;
+
+const char kMagic[8] = {'W', 'V', 'L', 'X', 'F', 'E', 'A', 'T'};
+constexpr uint32_t kVersion = 1;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t encoding;
+    uint64_t frames;
+    uint32_t mels;
+    uint32_t mfccs;
+    uint32_t fftsz;
+    uint32_t fragsz;
+    double rate;
+    double fmin;
+    double fmax;
+};
+
+double HzToMel(double hz) {
+    return 2595.0 * log10(1.0 + hz / 700.0);
+}
+
+double MelToHz(double mel) {
+    return 700.0 * (pow(10.0, mel / 2595.0) - 1.0);
+}
+}  // namespace
+
+bool MelFeatures::Init(double rate, int fftsz, int bins, int mels, int mfccs,
+                       double fmin, double fmax) {
+    rate_ = rate;
+    fftsz_ = fftsz;
+    bins_ = bins;
+    mels_ = mels;
+    mfccs_ = std::min(mfccs, mels);
+    fmin_ = fmin;
+    fmax_ = fmax > 0 ? std::min(fmax, rate / 2) : rate / 2;
+    frames_ = 0;
+    features_.clear();
+
+    // Triangles between adjacent points evenly spaced in mel, each rising
+    // from 0 at its left neighbor to 1 at its center and back to 0.
+    double m0 = HzToMel(fmin_), m1 = HzToMel(fmax_);
+    lo_.assign(mels_, 0);
+    start_.assign(mels_ + 1, 0);
+    weight_.clear();
+    double bin_hz = rate_ / fftsz_;
+    for(int m=0; m<mels_; ++m) {
+        double left = MelToHz(m0 + (m1 - m0) * m / (mels_ + 1));
+        double center = MelToHz(m0 + (m1 - m0) * (m + 1) / (mels_ + 1));
+        double right = MelToHz(m0 + (m1 - m0) * (m + 2) / (mels_ + 1));
+        int lo = std::max(0, int(std::ceil(left / bin_hz)));
+        int hi = std::min(bins_, int(std::floor(right / bin_hz)) + 1);
+        lo_[m] = lo;
+        for(int b=lo; b<hi; ++b) {
+            double f = b * bin_hz;
+            double w = f <= center ? (f - left) / (center - left)
+                                   : (right - f) / (right - center);
+            weight_.push_back(float(std::max(0.0, w)));
+        }
+        start_[m + 1] = weight_.size();
+        if (start_[m + 1] == start_[m]) {
+            LOG(ERROR, "MelFeatures: filter ", m, " at ", center,
+                " Hz covers no bins; use fewer mels or a longer FFT");
+            mels_ = 0;
+            return false;
+        }
+    }
+
+    dct_.resize(mfccs_ * mels_);
+    for(int k=0; k<mfccs_; ++k) {
+        double scale = sqrt((k ? 2.0 : 1.0) / mels_);
+        for(int m=0; m<mels_; ++m) {
+            dct_[k * mels_ + m] = scale * cos(pi * k * (m + 0.5) / mels_);
+        }
+    }
+    return true;
+}
+
+double MelFeatures::frequency(int m) const {
+    double m0 = HzToMel(fmin_), m1 = HzToMel(fmax_);
+    return MelToHz(m0 + (m1 - m0) * (m + 1) / (mels_ + 1));
+}
+
+void MelFeatures::Frame(const float* db, float* power, float* mel,
+                        float* mfcc) const {
+    // db is 10*log10(power), up to a constant that only offsets the mels.
+    sound::vector::Scale(power, db, 0.1f, bins_);
+    sound::vector::Exp10(power, power, bins_);
+    for(int m=0; m<mels_; ++m) {
+        size_t len = start_[m + 1] - start_[m];
+        mel[m] = std::max(kMelFloor,
+                          sound::vector::Dot(power + lo_[m],
+                                             weight_.data() + start_[m], len));
+    }
+    sound::vector::Log10(mel, mel, mels_);
+    sound::vector::Scale(mel, mel, 10.0f, mels_);
+    for(int k=0; k<mfccs_; ++k) {
+        mfcc[k] = sound::vector::Dot(dct_.data() + k * mels_, mel, mels_);
+    }
+}
+
+void MelFeatures::AnalyzeWorker(const FFTChannel& fft,
+                                const sound::Channel& channel, bool sweep,
+                                const std::atomic<bool>* cancel) {
+    std::vector<float> db(bins_), power(bins_);
+    int chunks = (frames_ + kChunkFrames - 1) / kChunkFrames;
+    for(;;) {
+        int chunk = next_chunk_++;
+        if (chunk >= chunks) break;
+        size_t begin = size_t(chunk) * kChunkFrames;
+        size_t end = std::min(begin + kChunkFrames, frames_);
+        if (sweep) {
+            fft.Sweep(channel, begin, end,
+                [this, &power](size_t n, const fftwf_complex* bins,
+                               const float* db) {
+                    float* out = features_.data() + n * stride();
+                    Frame(db, power.data(), out, out + mels_);
+                }, cancel);
+        } else {
+            for(size_t n=begin; n<end && !(cancel && *cancel); ++n) {
+                fft.PowerDb(n, db.data(), bins_);
+                float* out = features_.data() + n * stride();
+                Frame(db.data(), power.data(), out, out + mels_);
+            }
+        }
+        if (cancel && *cancel) break;
+        done_ += end - begin;
+    }
+}
+
+bool MelFeatures::Analyze(const FFTChannel& fft,
+                          const sound::Channel& channel,
+                          const std::atomic<bool>* cancel) {
+    if (!mels_ || fft.bins() != bins_) {
+        LOG(ERROR, "MelFeatures: not initialized for this FFT");
+        return false;
+    }
+    fragsz_ = fft.fragsz();
+    frames_ = fft.fragments(channel);
+    features_.assign(frames_ * stride(), 0.0f);
+    next_chunk_ = 0;
+    done_ = 0;
+    bool sweep = fft.lazy() || fft.size() < frames_;
+
+    int chunks = (frames_ + kChunkFrames - 1) / kChunkFrames;
+    int threads = threads_;
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max(1, std::min(threads, chunks));
+    std::vector<std::thread> workers;
+    for(int t=1; t<threads; ++t) {
+        workers.emplace_back(&MelFeatures::AnalyzeWorker, this,
+                             std::cref(fft), std::cref(channel), sweep,
+                             cancel);
+    }
+    AnalyzeWorker(fft, channel, sweep, cancel);
+    for(auto& w : workers) {
+        w.join();
+    }
+    return !(cancel && *cancel);
+}
+
+bool MelFeatures::Save(const std::string& filename,
+                       Encoding encoding) const {
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        LOG(ERROR, "MelFeatures: could not create ", filename);
+        return false;
+    }
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.encoding = encoding;
+    h.frames = frames_;
+    h.mels = mels_;
+    h.mfccs = mfccs_;
+    h.fftsz = fftsz_;
+    h.fragsz = fragsz_;
+    h.rate = rate_;
+    h.fmin = fmin_;
+    h.fmax = fmax_;
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    if (ok && encoding == FLOAT16) {
+        std::vector<uint16_t> half(stride());
+        for(size_t n=0; ok && n<frames_; ++n) {
+            const float* f = mel(n);
+            for(size_t i=0; i<stride(); ++i) {
+                half[i] = sound::FloatToHalf(f[i]);
+            }
+            ok = fwrite(half.data(), sizeof(uint16_t), half.size(), fp)
+                 == half.size();
+        }
+    } else if (ok) {
+        ok = fwrite(features_.data(), sizeof(float), features_.size(), fp)
+             == features_.size();
+    }
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        LOG(ERROR, "MelFeatures: could not write ", filename);
+        remove(filename.c_str());
+        return false;
+    }
+    LOG(INFO, "MelFeatures: wrote ", frames_, " frames to ", filename);
+    return true;
+}
+
+}  // namespace audio
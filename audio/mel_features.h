@@ -0,0 +1,101 @@
+#ifndef WVLX_AUDIO_MEL_FEATURES_H
+#define WVLX_AUDIO_MEL_FEATURES_H
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "audio/fft_channel.h"
+#include "util/sound/file.h"
+
+namespace audio {
+// Log-mel energies and MFCCs computed from FFTChannel fragments.
+//
+// Each frame's power spectrum passes through a sparse bank of triangular
+// mel filters, each stored as the contiguous band of bins it covers.  The
+// filter energies are converted to dB, and an orthonormal DCT-II of those
+// gives the MFCCs.
+class MelFeatures {
+  public:
+    // How Save stores values: FLOAT16 halves the file.
+    enum Encoding {
+        FLOAT32 = 0,
+        FLOAT16 = 1,
+    };
+
+    MelFeatures() {}
+
+    // Plans |mels| filters spaced evenly on the mel scale from |fmin| to
+    // |fmax| (0 for Nyquist), and the first |mfccs| cepstral coefficients,
+    // for spectra of |bins| bins of an |fftsz|-point transform at |rate|.
+    // Returns false if the parameters leave an empty filter.
+    bool Init(double rate, int fftsz, int bins, int mels=40, int mfccs=13,
+              double fmin=0, double fmax=0);
+    // Computes the features of every fragment of |channel| across
+    // threads() worker threads.  Stored fragments of |fft| are read as
+    // they are; in on-demand mode, or if |fft| is incomplete, each thread
+    // sweeps its own range of fragments instead.  Init must have been
+    // called with |fft|'s parameters.  Returns false if cancelled.
+    bool Analyze(const FFTChannel& fft, const sound::Channel& channel,
+                 const std::atomic<bool>* cancel=nullptr);
+    // Computes the features of one frame from the power of its bins() bins
+    // in dB.  |mel| receives mels() values and |mfcc| mfccs(); |power| is
+    // bins() floats of scratch.
+    void Frame(const float* db, float* power, float* mel, float* mfcc) const;
+
+    // Writes the features to |filename|: a fixed header, then each frame's
+    // mels() log-mel energies followed by its mfccs() coefficients.
+    bool Save(const std::string& filename, Encoding encoding=FLOAT32) const;
+
+    // The log-mel energies and MFCCs of frame |n|.
+    inline const float* mel(size_t n) const {
+        return features_.data() + n * stride();
+    }
+    inline const float* mfcc(size_t n) const { return mel(n) + mels_; }
+    // The center frequency of mel filter |m| in Hz.
+    double frequency(int m) const;
+
+    inline size_t frames() const { return frames_; }
+    inline int mels() const { return mels_; }
+    inline int mfccs() const { return mfccs_; }
+    inline int bins() const { return bins_; }
+    inline double progress() const {
+        size_t total = frames_;
+        return total ? double(done_) / double(total) : 0.0;
+    }
+    // The number of threads used by Analyze; 0 uses every hardware
+    // thread.
+    inline int threads() const { return threads_; }
+    inline void set_threads(int t) { threads_ = t; }
+
+  private:
+    inline size_t stride() const { return mels_ + mfccs_; }
+    void AnalyzeWorker(const FFTChannel& fft, const sound::Channel& channel,
+                       bool sweep, const std::atomic<bool>* cancel);
+
+    double rate_ = 0;
+    int fftsz_ = 0;
+    int fragsz_ = 0;
+    int bins_ = 0;
+    int mels_ = 0;
+    int mfccs_ = 0;
+    double fmin_ = 0;
+    double fmax_ = 0;
+    int threads_ = 0;
+
+    // Filter m covers bins [lo_[m], lo_[m] + len) where len is
+    // start_[m+1] - start_[m]; its weights are weight_[start_[m]...].
+    std::vector<int> lo_;
+    std::vector<int> start_;
+    std::vector<float> weight_;
+    // mfccs() rows of mels() DCT-II coefficients.
+    std::vector<float> dct_;
+
+    size_t frames_ = 0;
+    std::vector<float> features_;
+    std::atomic<int> next_chunk_{0};
+    std::atomic<size_t> done_{0};
+};
+
+}  // namespace audio
+#endif // WVLX_AUDIO_MEL_FEATURES_H
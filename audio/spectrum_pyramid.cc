@@ -0,0 +1,115 @@
+#include "audio/spectrum_pyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "absl/memory/memory.h"
+
+namespace audio {
+
+void SpectrumPyramid::Reset(size_t fragments, size_t bins) {
+    fragments_ = fragments;
+    bins_ = bins;
+    complete_ = false;
+    cell_.resize(bins_);
+    level_.clear();
+    // Level 0 is the fragments themselves and is never kept here.
+    level_.emplace_back(absl::make_unique<Level>());
+    if (fragments_ == 0) return;
+    for(int k=1; (fragments_ - 1) >> (k - 1) > 0; ++k) {
+        auto level = absl::make_unique<Level>();
+        size_t cells = (fragments_ + (size_t(1) << k) - 1) >> k;
+        level->kept = cells <= max_cells_;
+        if (level->kept) {
+            level->store.Reset(cells, bins_, FrameStore::TIME_MAJOR,
+                               FrameStore::DB);
+        }
+        level->acc.resize(bins_);
+        level_.emplace_back(std::move(level));
+    }
+}
+
+void SpectrumPyramid::Add(const float* db) {
+    if (level_.size() > 1) Accumulate(1, db);
+}
+
+void SpectrumPyramid::Accumulate(int level, const float* db) {
+    Level* lv = level_[level].get();
+    float* acc = lv->acc.data();
+    if (pool_ == Pool::MAX) {
+        if (lv->children == 0) {
+            std::copy(db, db + bins_, acc);
+        } else {
+            for(size_t b=0; b<bins_; ++b) acc[b] = std::max(acc[b], db[b]);
+        }
+    } else {
+        // Average power, not dB.
+        if (lv->children == 0) std::fill(acc, acc + bins_, 0.0f);
+        for(size_t b=0; b<bins_; ++b) acc[b] += powf(10.0f, db[b] / 10.0f);
+    }
+    if (++lv->children == 2) Emit(level);
+}
+
+void SpectrumPyramid::Emit(int level) {
+    Level* lv = level_[level].get();
+    if (pool_ == Pool::MAX) {
+        std::copy(lv->acc.begin(), lv->acc.end(), cell_.begin());
+    } else {
+        for(size_t b=0; b<bins_; ++b) {
+            cell_[b] = 10.0f * log10f(lv->acc[b] / lv->children);
+        }
+    }
+    lv->children = 0;
+    if (lv->kept) lv->store.PutDb(lv->next, cell_.data());
+    ++lv->next;
+    lv->ready = lv->next;
+    if (level + 1 < int(level_.size())) {
+        // Accumulate is done reading cell_ before it can Emit again.
+        Accumulate(level + 1, cell_.data());
+    }
+}
+
+void SpectrumPyramid::Finish() {
+    for(size_t k=1; k<level_.size(); ++k) {
+        if (level_[k]->children) Emit(k);
+    }
+    complete_ = true;
+}
+
+int SpectrumPyramid::LevelFor(double fragments_per_pixel) const {
+    int best = 0;
+    for(int k=1; k<int(level_.size()); ++k) {
+        if (double(size_t(1) << k) > fragments_per_pixel) break;
+        if (level_[k]->kept) best = k;
+    }
+    return best;
+}
+
+size_t SpectrumPyramid::cells(int level) const {
+    if (level <= 0 || level >= int(level_.size())) return fragments_;
+    return (fragments_ + (size_t(1) << level) - 1) >> level;
+}
+
+bool SpectrumPyramid::ready(int level, size_t cell) const {
+    if (level <= 0 || level >= int(level_.size())) return false;
+    return level_[level]->kept && cell < level_[level]->ready;
+}
+
+bool SpectrumPyramid::PowerDb(int level, size_t cell, float* db,
+                              size_t count) const {
+    size_t b = 0;
+    bool ok = ready(level, cell);
+    if (ok) {
+        const FrameStore& store = level_[level]->store;
+        for(; b<count && b<bins_; ++b) {
+            db[b] = store.db(cell, b);
+        }
+    }
+    for(; b<count; ++b) {
+        db[b] = -std::numeric_limits<float>::infinity();
+    }
+    return ok;
+}
+
+}  // namespace audio
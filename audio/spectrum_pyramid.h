@@ -0,0 +1,69 @@
+#ifndef WVLX_AUDIO_SPECTRUM_PYRAMID_H
+#define WVLX_AUDIO_SPECTRUM_PYRAMID_H
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "audio/frame_store.h"
+
+namespace audio {
+
+// A time-axis pyramid over a spectrogram: a cell of level k pools the
+// power of 2^k consecutive fragments, so a zoomed-out view can show one
+// cell per pixel column without skipping any fragments.  Fragments are
+// fed in order with Add, typically on a background thread; cells may be
+// read as soon as ready() says so.  Levels with more than max_cells
+// cells are pooled through but not kept, which bounds memory; views that
+// fine fall back to the fragments themselves.
+class SpectrumPyramid {
+  public:
+    enum Pool {
+        MAX = 0,
+        MEAN = 1,
+    };
+
+    explicit SpectrumPyramid(Pool pool=Pool::MAX, size_t max_cells=16384)
+      : pool_(pool), max_cells_(max_cells) {}
+
+    // Prepares for |fragments| fragments of |bins| bins each.
+    void Reset(size_t fragments, size_t bins);
+    // Adds the next fragment's power in dB.
+    void Add(const float* db);
+    // Emits any partial cells at the end of the fragments.
+    void Finish();
+
+    // The kept level whose cells best match |fragments_per_pixel|, or 0
+    // if the view is fine enough to show fragments directly.
+    int LevelFor(double fragments_per_pixel) const;
+    inline int levels() const { return int(level_.size()) - 1; }
+    size_t cells(int level) const;
+    bool ready(int level, size_t cell) const;
+    inline bool complete() const { return complete_; }
+    // Fills |db| with the first |count| bins of |cell| at |level|.
+    // Returns false, filling with -infinity, if it isn't ready.
+    bool PowerDb(int level, size_t cell, float* db, size_t count) const;
+
+  private:
+    struct Level {
+        bool kept = false;
+        FrameStore store;
+        // The cell being pooled and how many children it has so far.
+        std::vector<float> acc;
+        int children = 0;
+        size_t next = 0;
+        std::atomic<size_t> ready{0};
+    };
+    void Accumulate(int level, const float* db);
+    void Emit(int level);
+
+    Pool pool_;
+    size_t max_cells_;
+    size_t fragments_ = 0;
+    size_t bins_ = 0;
+    std::vector<float> cell_;
+    std::vector<std::unique_ptr<Level>> level_;
+    std::atomic<bool> complete_{false};
+};
+
+}  // namespace audio
+#endif // WVLX_AUDIO_SPECTRUM_PYRAMID_H
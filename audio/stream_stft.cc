@@ -0,0 +1,107 @@
+#include "audio/stream_stft.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace audio {
+
+StreamingSTFT::StreamingSTFT(const FFTChannel* fft, double rate,
+                             size_t history, double max_latency)
+  : fft_(fft),
+  rate_(rate),
+  history_(std::max(size_t(1), history)),
+  // Always leave room for a whole window, or no frame could form.
+  max_backlog_(std::max(size_t(max_latency * rate),
+                        size_t(fft->winsz() + fft->fragsz()))),
+  // Twice the backlog, so the audio thread has slack until the consumer
+  // next trims it.
+  ring_(2 * max_backlog_),
+  pending_(fft->winsz()),
+  frame_(fft->winsz()) {
+    store_.Reset(history_, fft->bins(), FrameStore::Layout::TIME_MAJOR,
+                 fft->storage());
+    if (fft->transform() == FFTChannel::Transform::REAL) {
+        rin_ = fftwf_alloc_real(fft->fftsz());
+    } else {
+        in_ = fftwf_alloc_complex(fft->fftsz());
+    }
+    out_ = fftwf_alloc_complex(fft->bins());
+}
+
+StreamingSTFT::~StreamingSTFT() {
+    fftwf_free(rin_);
+    fftwf_free(in_);
+    fftwf_free(out_);
+}
+
+void StreamingSTFT::Push(const float* samples, size_t n) {
+    size_t written = ring_.Write(samples, n);
+    if (written < n) {
+        dropped_.fetch_add(n - written, std::memory_order_relaxed);
+    }
+}
+
+size_t StreamingSTFT::Process() {
+    // Bound the latency: anything older than max_backlog_ is stale, so
+    // drop it and start a fresh window.
+    size_t waiting = ring_.available();
+    if (waiting > max_backlog_) {
+        size_t lost = ring_.Skip(waiting - max_backlog_) + filled_;
+        dropped_.fetch_add(lost, std::memory_order_relaxed);
+        filled_ = 0;
+        skip_ = 0;
+    }
+
+    size_t winsz = pending_.size();
+    size_t fragsz = fft_->fragsz();
+    size_t frames = 0;
+    for(;;) {
+        if (skip_) {
+            skip_ -= ring_.Skip(skip_);
+            if (skip_) break;
+        }
+        filled_ += ring_.Read(pending_.data() + filled_, winsz - filled_);
+        if (filled_ < winsz) break;
+
+        // Forward overwrites its input, so hand it a copy.
+        std::copy(pending_.begin(), pending_.end(), frame_.begin());
+        fft_->Forward(frame_.data(), rin_, in_, out_);
+        store_.Put(size_ % history_, out_);
+        ++size_;
+        ++frames;
+
+        if (fragsz < winsz) {
+            memmove(pending_.data(), pending_.data() + fragsz,
+                    (winsz - fragsz) * sizeof(float));
+            filled_ = winsz - fragsz;
+        } else {
+            filled_ = 0;
+            skip_ = fragsz - winsz;
+        }
+    }
+    return frames;
+}
+
+float StreamingSTFT::PowerDb(size_t n, size_t bin) const {
+    if (!ready(n) || bin >= size_t(bins())) {
+        return -std::numeric_limits<float>::infinity();
+    }
+    return store_.db(n % history_, bin);
+}
+
+bool StreamingSTFT::PowerDb(size_t n, float* db, size_t count) const {
+    bool ok = ready(n);
+    size_t b = 0;
+    if (ok) {
+        for(; b<count && b<size_t(bins()); ++b) {
+            db[b] = store_.db(n % history_, b);
+        }
+    }
+    for(; b<count; ++b) {
+        db[b] = -std::numeric_limits<float>::infinity();
+    }
+    return ok;
+}
+
+}  // namespace audio
@@ -0,0 +1,86 @@
+#ifndef WVLX_AUDIO_STREAM_STFT_H
+#define WVLX_AUDIO_STREAM_STFT_H
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <fftw3.h>
+
+#include "audio/fft_channel.h"
+#include "audio/frame_store.h"
+#include "util/sound/ring_buffer.h"
+
+namespace audio {
+// A spectrogram of live input, computed as it arrives.
+//
+// The audio thread hands blocks of any size to Push, which only copies
+// them into a lock-free ring.  Process, called from one consumer thread
+// (normally the UI thread, once per frame), drains the ring and transforms
+// each complete window into the next frame of a rolling store of the last
+// history() frames.  Readers on the consumer thread never race the writer.
+class StreamingSTFT {
+  public:
+    // |fft| supplies the window, transform, fragment size and storage
+    // format and must outlive this.  Input is at |rate|.  At most
+    // |max_latency| seconds of input wait in the ring: Process discards
+    // anything older so the display never falls further behind.
+    StreamingSTFT(const FFTChannel* fft, double rate, size_t history,
+                  double max_latency=0.25);
+    ~StreamingSTFT();
+
+    // Audio thread: queues |n| samples.  Never allocates, locks or blocks;
+    // samples that don't fit are dropped and counted.
+    void Push(const float* samples, size_t n);
+    // Consumer thread: transforms all complete windows waiting in the ring
+    // and returns the number of new frames.
+    size_t Process();
+
+    // Frames computed since the start; frame n covers input samples
+    // [n*fragsz(), n*fragsz() + winsz()).
+    inline size_t size() const { return size_; }
+    // The oldest frame still held.
+    inline size_t first() const {
+        return size_ > history_ ? size_ - history_ : 0;
+    }
+    inline bool ready(size_t n) const { return n >= first() && n < size_; }
+    // The power in dB of |bin| of frame |n|, or -infinity if it isn't
+    // held.
+    float PowerDb(size_t n, size_t bin) const;
+    // Fills |db| with the first |count| bins of frame |n|.  Returns false,
+    // filling with -infinity, if it isn't held.
+    bool PowerDb(size_t n, float* db, size_t count) const;
+
+    inline size_t history() const { return history_; }
+    inline int bins() const { return fft_->bins(); }
+    inline int fftsz() const { return fft_->fftsz(); }
+    inline int fragsz() const { return fft_->fragsz(); }
+    inline double rate() const { return rate_; }
+    // Seconds of input queued but not yet transformed.
+    inline double backlog() const {
+        return double(ring_.available() + filled_) / rate_;
+    }
+    // Input samples lost to a full ring or to the latency bound.
+    inline uint64_t dropped() const { return dropped_; }
+
+  private:
+    const FFTChannel* fft_;
+    double rate_;
+    size_t history_;
+    size_t max_backlog_;
+    sound::RingBuffer ring_;
+    FrameStore store_;
+    size_t size_ = 0;
+    // The window being assembled, and how much of it is filled.
+    std::vector<float> pending_;
+    size_t filled_ = 0;
+    // Input still to skip when fragments are longer than the window.
+    size_t skip_ = 0;
+    // Transform scratch.
+    std::vector<float> frame_;
+    float* rin_ = nullptr;
+    fftwf_complex* in_ = nullptr;
+    fftwf_complex* out_ = nullptr;
+    std::atomic<uint64_t> dropped_{0};
+};
+
+}  // namespace audio
+#endif // WVLX_AUDIO_STREAM_STFT_H
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "audio/fft_channel.h"
+#include "util/sound/file.h"
+
+DEFINE_double(seconds, 120, "Length of the synthetic signal");
+DEFINE_double(rate, 48000, "Sample rate of the synthetic signal");
+DEFINE_string(fftsz, "1024,4096,16384", "FFT sizes to time");
+DEFINE_int32(fragsz, 512, "Samples between frames");
+DEFINE_string(batch, "1,2,4,8,16,32,64", "Batch sizes to time");
+DEFINE_int32(threads, 0, "Analyze threads; 0 uses every hardware thread.");
+DEFINE_bool(measure, true, "Plan with FFTW_MEASURE rather than ESTIMATE.");
+DEFINE_int32(repeat, 3, "Runs of each timing; the fastest is reported.");
+
+const char kUsage[] =
+R"ZZZ(<optional flags>
+
+Description:
+  Times FFTChannel::Analyze of a synthetic signal for each combination of
+  FFT size and batch size, to check the default batch on this machine.
+)ZZZ";
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<int> ParseList(const std::string& list) {
+    std::vector<int> result;
+    for(auto item : absl::StrSplit(list, ',', absl::SkipEmpty())) {
+        int v;
+        if (absl::SimpleAtoi(item, &v) && v > 0) result.push_back(v);
+    }
+    return result;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    gflags::SetUsageMessage(kUsage);
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    if (argc != 1) {
+        fprintf(stderr, "Usage: %s %s", argv[0], kUsage);
+        return 1;
+    }
+
+    size_t samples = size_t(FLAGS_seconds * FLAGS_rate);
+    std::vector<float> signal(samples);
+    for(size_t i=0; i<samples; ++i) {
+        double t = i / FLAGS_rate;
+        signal[i] = 0.5 * sin(2 * M_PI * 440 * t) +
+                    0.25 * sin(2 * M_PI * 3520 * t);
+    }
+    sound::Channel channel(signal.data(), samples, FLAGS_rate);
+
+    printf("%zu samples, fragsz %d, %d threads\n",
+           samples, FLAGS_fragsz, FLAGS_threads);
+    printf("%6s %6s %10s %12s\n", "fftsz", "batch", "analyze", "frames/s");
+    for(int fftsz : ParseList(FLAGS_fftsz)) {
+        for(int batch : ParseList(FLAGS_batch)) {
+            audio::FFTChannel fft;
+            fft.set_threads(FLAGS_threads);
+            // DB keeps the store small enough that allocating it inside
+            // Analyze doesn't swamp the transforms being timed.
+            fft.set_storage(audio::FrameStore::DB);
+            fft.set_batch(batch);
+            fft.set_effort(FLAGS_measure ? audio::FFTChannel::MEASURE
+                                         : audio::FFTChannel::ESTIMATE);
+            fft.Init(fftsz, fftsz, audio::FFTChannel::WindowFn::HANN,
+                     audio::FFTChannel::Transform::REAL);
+            fft.set_fragsz(FLAGS_fragsz);
+            double best = 0;
+            for(int r=0; r<FLAGS_repeat; ++r) {
+                auto start = Clock::now();
+                fft.Analyze(channel);
+                double s = std::chrono::duration<double>(
+                        Clock::now() - start).count();
+                if (r == 0 || s < best) best = s;
+            }
+            printf("%6d %6d %9.3fs %12.0f\n", fftsz, batch, best,
+                   fft.size() / best);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include <gflags/gflags.h>
+#include "audio/fft_channel.h"
+#include "audio/mel_features.h"
+#include "util/logging.h"
+#include "util/sound/file.h"
+
+DEFINE_string(out, "", "Feature file to write; defaults to the input "
+                       "filename with .feat appended.");
+DEFINE_int32(fftsz, 4096, "FFT size");
+DEFINE_int32(fragsz, 512, "Samples between frames");
+DEFINE_int32(mels, 40, "Number of mel filters");
+DEFINE_int32(mfccs, 13, "Number of cepstral coefficients");
+DEFINE_double(fmin, 0, "Lowest mel filter edge in Hz");
+DEFINE_double(fmax, 0, "Highest mel filter edge in Hz; 0 for Nyquist");
+DEFINE_double(analysis_rate, 0, "If nonzero, resample to this rate first.");
+DEFINE_int32(threads, 0, "Worker threads; 0 uses every hardware thread.");
+DEFINE_bool(half, false, "Store 16-bit floats instead of 32-bit.");
+
+const char kUsage[] =
+R"ZZZ(<optional flags> <audio file>
+
+Description:
+  Writes the log-mel energies and MFCCs of an audio file, mixed to mono,
+  as a binary feature file.
+)ZZZ";
+
+int main(int argc, char *argv[]) {
+    gflags::SetUsageMessage(kUsage);
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s %s", argv[0], kUsage);
+        return 1;
+    }
+    std::string filename = argv[1];
+    std::string out = FLAGS_out.empty() ? filename + ".feat" : FLAGS_out;
+
+    auto file = sound::File::Open(filename, true);
+    if (!file) {
+        LOG(ERROR, "Could not open ", filename);
+        return 1;
+    }
+    while(file->Decode() > 0) {}
+    std::shared_ptr<sound::Channel> channel = file->channel(0);
+    if (FLAGS_analysis_rate && FLAGS_analysis_rate != channel->rate()) {
+        channel = channel->Resample(FLAGS_analysis_rate);
+    }
+
+    // The features read each fragment once, so nothing is stored.
+    audio::FFTChannel fft;
+    fft.Init(FLAGS_fftsz, FLAGS_fftsz, audio::FFTChannel::WindowFn::HANN,
+             audio::FFTChannel::Transform::REAL);
+    fft.set_fragsz(FLAGS_fragsz);
+
+    audio::MelFeatures features;
+    if (!features.Init(channel->rate(), fft.fftsz(), fft.bins(), FLAGS_mels,
+                       FLAGS_mfccs, FLAGS_fmin, FLAGS_fmax)) {
+        return 1;
+    }
+    features.set_threads(FLAGS_threads);
+    features.Analyze(fft, *channel);
+    auto encoding = FLAGS_half ? audio::MelFeatures::FLOAT16
+                               : audio::MelFeatures::FLOAT32;
+    return features.Save(out, encoding) ? 0 : 1;
+}
@@ -6,34 +6,74 @@
 namespace audio {
 
 void FFTCache::Redraw() {
+    lru_.clear();
+    index_.clear();
+}
+
+GLBitmap* FFTCache::bitmap(size_t n, int level) {
+    uint64_t key = uint64_t(level) << 56 | n;
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->bitmap.get();
+    }
+    bool ready = level ? pyramid_->ready(level, n)
+               : cqt_ ? cqt_->ready(n) : channel_->ready(n);
+    if (!ready) return nullptr;
+
+    // Reuse the least recently used bitmap rather than making a new one.
+    std::unique_ptr<GLBitmap> bm;
+    if (lru_.size() >= kMaxBitmaps) {
+        bm = std::move(lru_.back().bitmap);
+        index_.erase(lru_.back().key);
+        lru_.pop_back();
+    } else {
+        bm = absl::make_unique<GLBitmap>(1, rows());
+    }
+    DrawFragment(n, level, bm.get());
+    lru_.push_front(Entry{key, std::move(bm)});
+    index_[key] = lru_.begin();
+    return lru_.front().bitmap.get();
+}
+
+std::pair<float, float> FFTCache::MagnitudeAt(double tm, int row) const {
+    if (cqt_) {
+        size_t n = size_t(tm * rate_) / fragsz_;
+        return std::make_pair(cqt_->PowerDb(n, row),
+                              float(cqt_->frequency(row)));
+    }
+    return channel_->MagnitudeAt(tm, row);
+}
+
+uint32_t FFTCache::Color(float db, float floor) {
     constexpr float twothirds = 2.0/3.0;
-    for(size_t i=0; i<channel_->size(); ++i) {
-        const FFTChannel::Fragment* f = channel_->fft(i);
-        if (i >= bitmap_.size()) {
-            bitmap_.emplace_back(absl::make_unique<GLBitmap>(1, fftsz_ / 2));
-        }
-        auto& bm = bitmap_[i];
-        for(int y=0; y<fftsz_/2; ++y) {
-            float re = f->at(y)[0];
-            float im = f->at(y)[1];
-            float mag = 2.0 * sqrtf(re*re + im*im);
-
-            float amp = -floor_ + 20.0f * log10f(mag);
-            if (amp < 0.0) amp = 0.0;
-            amp /= -floor_;
-
-            float hue = twothirds - twothirds * amp;
-            float val = 0.25f + 0.75f * amp;
-            float r,g,b;
-            ImGui::ColorConvertHSVtoRGB(hue, 1.0f, val, r, g, b);
-            uint32_t color = uint8_t(r * 255.0) << 0 |
-                             uint8_t(g * 255.0) << 8 |
-                             uint8_t(b * 255.0) << 16 |
-                             0xFF000000;
-            bm->SetPixel(0, y, color);
-        }
-        bm->Update();
+    float amp = -floor + db;
+    if (amp < 0.0) amp = 0.0;
+    amp /= -floor;
+
+    float hue = twothirds - twothirds * amp;
+    float val = 0.25f + 0.75f * amp;
+    float r,g,b;
+    ImGui::ColorConvertHSVtoRGB(hue, 1.0f, val, r, g, b);
+    return uint8_t(r * 255.0) << 0 |
+           uint8_t(g * 255.0) << 8 |
+           uint8_t(b * 255.0) << 16 |
+           0xFF000000;
+}
+
+void FFTCache::DrawFragment(size_t i, int level, GLBitmap* bm) {
+    db_.resize(rows());
+    if (level) {
+        pyramid_->PowerDb(level, i, db_.data(), db_.size());
+    } else if (cqt_) {
+        cqt_->PowerDb(i, db_.data(), db_.size());
+    } else {
+        channel_->PowerDb(i, db_.data(), db_.size());
+    }
+    for(int y=0; y<rows(); ++y) {
+        bm->SetPixel(0, y, Color(db_[y], floor_));
     }
+    bm->Update();
 }
 
 }  // namespace audio
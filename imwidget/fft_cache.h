@@ -1,48 +1,105 @@
 #ifndef WVLX_IMWIDGET_FFT_CACHE_H
 #define WVLX_IMWIDGET_FFT_CACHE_H
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "audio/cqt_channel.h"
 #include "audio/fft_channel.h"
+#include "audio/spectrum_pyramid.h"
 #include "imwidget/glbitmap.h"
 
 namespace audio {
 
 class FFTCache {
   public:
-    FFTCache(const FFTChannel* channel)
+    // With |cqt|, columns show its log-frequency bins instead of the
+    // channel's linear ones; the channel still sets the time axis.
+    FFTCache(FFTChannel* channel, const SpectrumPyramid* pyramid=nullptr,
+             const CQTChannel* cqt=nullptr)
       : channel_(channel),
+      pyramid_(pyramid),
+      cqt_(cqt),
       fftsz_(channel->fftsz()),
       winsz_(channel->winsz()),
       fragsz_(channel->fragsz()),
       rate_(channel->rate()),
-      length_(channel->length()) { Redraw(); }
+      length_(channel->length()) {}
 
+    // Discards every bitmap, e.g. after the floor changes.  They are
+    // redrawn as they are shown.
     void Redraw();
-    GLBitmap* at(double tm) const {
+    // Tells an on-demand channel which columns are about to be shown.
+    void Request(double t0, double dt, int count) {
+        channel_->Request(t0, dt, count);
+    }
+    // The pyramid level to draw at |fragments_per_pixel|; 0 draws the
+    // fragments themselves.
+    int LevelFor(double fragments_per_pixel) const {
+        return pyramid_ && !cqt_ ? pyramid_->LevelFor(fragments_per_pixel)
+                                 : 0;
+    }
+    // True if the view at |level| still needs fragments from the channel.
+    bool NeedsFragments(int level) const {
+        return !cqt_ && (level == 0 || !pyramid_->complete());
+    }
+    // The column at time |tm|, taken from |level| of the pyramid if that
+    // cell is ready and from the fragment itself otherwise.
+    GLBitmap* at(double tm, int level=0) {
         size_t n = size_t(tm * rate_) / fragsz_;
+        if (level > 0 && pyramid_->ready(level, n >> level)) {
+            return bitmap(n >> level, level);
+        }
         return bitmap(n);
-        
-    }
-    GLBitmap* bitmap(size_t n) const {
-        return n < bitmap_.size() ? bitmap_[n].get() : nullptr;
     }
+    // Returns the bitmap for cell |n| of |level| (level 0 being the
+    // fragments), drawing it on first use, or nullptr if it hasn't been
+    // computed yet.  At most kMaxBitmaps are kept, evicting the least
+    // recently used.
+    GLBitmap* bitmap(size_t n, int level=0);
     inline int fftsz() const { return fftsz_; }
     inline int winsz() const { return winsz_; }
     inline int fragsz() const { return fragsz_; }
     inline double rate() const { return rate_; }
     inline double length() const { return length_; }
-    inline size_t size() { return bitmap_.size(); }
+    inline size_t size() { return lru_.size(); }
+    // The rows of each column and the frequency, in Hz, of row |row|.
+    inline int rows() const { return cqt_ ? cqt_->bins() : fftsz_ / 2; }
+    inline double RowFrequency(double row) const {
+        return cqt_ ? cqt_->frequency(row) : row * rate_ / fftsz_;
+    }
+    // The power in dB and estimated frequency at |row| and time |tm|.
+    std::pair<float, float> MagnitudeAt(double tm, int row) const;
+    // The color of a pixel of |db|, shading from blue at |floor| to red
+    // at 0 dB.
+    static uint32_t Color(float db, float floor);
 
     const FFTChannel* fft() const { return channel_; }
     // Return a ref so imgui can adjust it.
     inline float& floor() { return floor_; }
   private:
-    const FFTChannel* channel_;
+    static constexpr size_t kMaxBitmaps = 8192;
+    struct Entry {
+        uint64_t key;
+        std::unique_ptr<GLBitmap> bitmap;
+    };
+    void DrawFragment(size_t i, int level, GLBitmap* bm);
+
+    FFTChannel* channel_;
+    const SpectrumPyramid* pyramid_;
+    const CQTChannel* cqt_;
     int fftsz_;
     int winsz_;
     int fragsz_;
     double rate_ = 0;
     double length_ = 0;
     float floor_ = -50.0;
-    std::vector<std::unique_ptr<GLBitmap>> bitmap_;
+    std::vector<float> db_;
+    std::list<Entry> lru_;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
 };
 
 }  // namespace audio
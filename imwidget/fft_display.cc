@@ -81,8 +81,14 @@ void FFTDisplay(const char* label, audio::FFTCache* channel,
     const ImVec2 uva(0.0, v0 + ivz);
 
     ImVec2 cursor = ImGui::GetCursorPos();
+    // Zoomed out, draw pooled cells from the pyramid so no fragment
+    // between columns is skipped.
+    int level = channel->LevelFor(ts * channel->rate() / channel->fragsz());
+    if (channel->NeedsFragments(level)) {
+        channel->Request(t, ts, int(width));
+    }
     for(float x=0; x<width; x+=1.0f, t+=ts) {
-        GLBitmap* bm = channel->at(t);
+        GLBitmap* bm = channel->at(t, level);
         if (!bm) continue;
         ImVec2 pos0 = inner_bb.Min + ImVec2(x, mid - hh);
         ImVec2 pos1 = inner_bb.Min + ImVec2(x+1, mid + hh);
@@ -138,8 +144,7 @@ void FFTDisplay(const char* label, audio::FFTCache* channel,
     // Compute the vertical scale
     float vn = truncf(2.0*hh / ticksize.y) - 2;
     float vs = 2*hh / vn;
-    double bsz = channel->rate() / double(channel->fftsz());
-    double vscale = double(channel->fftsz() / 2) / (2.0*hh);
+    double vscale = double(channel->rows()) / (2.0*hh);
     double vz = ivz * vscale;
     bot = v0 / ivz * 2*hh;
     window->DrawList->AddLine(inner_bb.Min + ImVec2(0, mid-hh),
@@ -152,7 +157,8 @@ void FFTDisplay(const char* label, audio::FFTCache* channel,
         if (bucket == lastb) continue;
         char buf[32];
         //snprintf(buf, sizeof(buf), "%d Hz", int(bucket+0.5));
-        snprintf(buf, sizeof(buf), "%.0f Hz", bucket*bsz);
+        snprintf(buf, sizeof(buf), "%.0f Hz",
+                 channel->RowFrequency(bucket));
         ImVec2 txtsz = ImGui::CalcTextSize(buf, nullptr, true);
         ImGui::RenderText(inner_bb.Min + ImVec2(8, mid+hh-y-txtsz.y/2.0), buf, nullptr, false);
 
@@ -167,9 +173,9 @@ void FFTDisplay(const char* label, audio::FFTCache* channel,
         float t = t0 + (g.IO.MousePos.x - inner_bb.Min.x) * ts;
         my = (mid+hh - my);
         int bucket = (bot + my) * vz;
-        auto mf = channel->fft()->MagnitudeAt(t, bucket);
+        auto mf = channel->MagnitudeAt(t, bucket);
         ImGui::SetTooltip("bin=%.0f Hz\nfreq=%.1f\nmag=%.2f dB",
-                bucket*bsz, mf.second, mf.first);
+                channel->RowFrequency(bucket), mf.second, mf.first);
     }
 
     ImGui::PushID(channel);
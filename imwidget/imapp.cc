@@ -158,7 +158,6 @@ void ImApp::BaseDraw() {
 
 void ImApp::InitAudio(int freq, int chan, int bufsz, SDL_AudioFormat fmt) {
     SDL_AudioSpec want, have;
-    SDL_AudioDeviceID dev;
 
     SDL_memset(&want, 0, sizeof(want));
     want.freq = freq;
@@ -168,9 +167,40 @@ void ImApp::InitAudio(int freq, int chan, int bufsz, SDL_AudioFormat fmt) {
     want.callback = ImApp::AudioCallback_;
     want.userdata = (void*)this;
 
-    dev = SDL_OpenAudioDevice(NULL, 0, &want, &have,
-                              SDL_AUDIO_ALLOW_FORMAT_CHANGE);
-    SDL_PauseAudioDevice(dev, 0);
+    audio_device_ = SDL_OpenAudioDevice(NULL, 0, &want, &have,
+                                        SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+    audio_rate_ = have.freq;
+    SDL_PauseAudioDevice(audio_device_, 0);
+}
+
+bool ImApp::InitCapture(int freq, int chan, int bufsz, SDL_AudioFormat fmt) {
+    SDL_AudioSpec want, have;
+
+    SDL_memset(&want, 0, sizeof(want));
+    want.freq = freq;
+    want.channels = chan;
+    want.samples = bufsz;
+    want.format = fmt;
+    want.callback = ImApp::CaptureCallback_;
+    want.userdata = (void*)this;
+
+    // Let SDL convert the format and channels so the callback always gets
+    // what was asked for; only the rate may differ.
+    capture_device_ = SDL_OpenAudioDevice(NULL, 1, &want, &have,
+                                          SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (!capture_device_) {
+        LOG(ERROR, "Could not open a capture device: ", SDL_GetError());
+        return false;
+    }
+    capture_rate_ = have.freq;
+    return true;
+}
+
+void ImApp::CloseCapture() {
+    if (capture_device_) {
+        SDL_CloseAudioDevice(capture_device_);
+        capture_device_ = 0;
+    }
 }
 
 void ImApp::HelpButton(const std::string& topickey, bool right_justify) {
@@ -191,6 +221,11 @@ void ImApp::AudioCallback_(void* userdata, uint8_t* stream, int len) {
     instance->AudioCallback((float*)stream, len/sizeof(float));
 }
 
+void ImApp::CaptureCallback_(void* userdata, uint8_t* stream, int len) {
+    ImApp* instance = (ImApp*)userdata;
+    instance->CaptureCallback((const float*)stream, len/sizeof(float));
+}
+
 void ImApp::AddDrawCallback(ImWindowBase* window) {
     draw_added_.emplace_back(window);
 }
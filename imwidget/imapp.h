@@ -19,6 +19,17 @@ class ImApp {
 
     void InitControllers();
     void InitAudio(int freq, int chan, int bufsz, SDL_AudioFormat fmt);
+    // Blocks the audio callback while state it reads is being replaced.
+    void LockAudio() { if (audio_device_) SDL_LockAudioDevice(audio_device_); }
+    void UnlockAudio() {
+        if (audio_device_) SDL_UnlockAudioDevice(audio_device_);
+    }
+    // Opens the default recording device, paused.  Once unpaused,
+    // CaptureCallback receives its samples on the audio thread.  Returns
+    // false if there is none.
+    bool InitCapture(int freq, int chan, int bufsz, SDL_AudioFormat fmt);
+    // Stops capture.  Call before destroying state CaptureCallback uses.
+    void CloseCapture();
     virtual void Init() {}
     virtual bool PreDraw() { return false; }
     virtual void Draw() {}
@@ -54,6 +65,7 @@ class ImApp {
 
   protected:
     virtual void AudioCallback(float* stream, int len);
+    virtual void CaptureCallback(const float* stream, int len) {}
     std::string name_;
     int width_;
     int height_;
@@ -61,10 +73,17 @@ class ImApp {
     ImVec4 clear_color_;
     DebugConsole console_;
     std::vector<std::unique_ptr<ImWindowBase>> draw_callback_;
+    SDL_AudioDeviceID audio_device_ = 0;
+    // The sample rate the audio device actually opened with.
+    int audio_rate_ = 0;
+    SDL_AudioDeviceID capture_device_ = 0;
+    // The sample rate the capture device actually opened with.
+    int capture_rate_ = 0;
 
   private:
     void Quit(DebugConsole* console, int argc, char **argv);
     static void AudioCallback_(void* userdata, uint8_t* stream, int len);
+    static void CaptureCallback_(void* userdata, uint8_t* stream, int len);
 
     static ImApp* singleton_;
 
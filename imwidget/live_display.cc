@@ -0,0 +1,127 @@
+#include "imwidget/live_display.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "absl/memory/memory.h"
+#include "imwidget/fft_cache.h"
+
+#ifndef IMGUI_DEFINE_MATH_OPERATORS
+#define IMGUI_DEFINE_MATH_OPERATORS
+#endif
+#include "imgui_internal.h"
+
+namespace audio {
+
+void LiveCache::Update() {
+    // Frames that aged out of the STFT before they were drawn are skipped.
+    next_ = std::max(next_, stft_->first());
+    db_.resize(rows());
+    for(; next_ < stft_->size(); ++next_) {
+        size_t slot = next_ % columns_.size();
+        auto& bm = columns_[slot];
+        if (!bm) bm = absl::make_unique<GLBitmap>(1, rows());
+        stft_->PowerDb(next_, db_.data(), db_.size());
+        for(int y=0; y<rows(); ++y) {
+            bm->SetPixel(0, y, FFTCache::Color(db_[y], floor_));
+        }
+        bm->Update();
+        drawn_[slot] = next_;
+    }
+}
+
+void LiveCache::Redraw() {
+    std::fill(drawn_.begin(), drawn_.end(), kNone);
+    next_ = 0;
+}
+
+GLBitmap* LiveCache::at(size_t n) {
+    size_t slot = n % columns_.size();
+    return drawn_[slot] == n ? columns_[slot].get() : nullptr;
+}
+
+}  // namespace audio
+
+void LiveDisplay(const char* label, audio::LiveCache* cache,
+                 ImVec2 graph_size) {
+    static ImVec2 ticksize = ImGui::CalcTextSize("00000 Hz", nullptr, true);
+    ImGuiWindow* window = ImGui::GetCurrentWindow();
+    if (window->SkipItems)
+        return;
+
+    ImGuiContext& g = *GImGui;
+    const ImGuiStyle& style = g.Style;
+
+    const ImVec2 label_size = ImGui::CalcTextSize(label, nullptr, true);
+    if (graph_size.x == 0.0f)
+        graph_size.x = ImGui::GetContentRegionAvailWidth();
+    if (graph_size.y == 0.0f)
+        graph_size.y = label_size.y + ticksize.y + (style.FramePadding.y * 2);
+
+    const ImRect frame_bb(window->DC.CursorPos, window->DC.CursorPos + graph_size);
+    const ImRect inner_bb(frame_bb.Min + style.FramePadding, frame_bb.Max - style.FramePadding);
+    ImGui::ItemSize(frame_bb, style.FramePadding.y);
+    if (!ImGui::ItemAdd(frame_bb, 0, nullptr))
+        return;
+
+    const bool hovered = ImGui::ItemHoverable(inner_bb, 0);
+    ImGui::RenderFrame(frame_bb.Min, frame_bb.Max,
+            ImGui::GetColorU32(ImGuiCol_FrameBg), true, style.FrameRounding);
+
+    cache->Update();
+    const audio::StreamingSTFT* stft = cache->stft();
+    float width = inner_bb.Max.x - inner_bb.Min.x;
+    float top = label_size.y;
+    float bot = inner_bb.Max.y - inner_bb.Min.y;
+    const ImVec2 uvb(0.0, 0.0);
+    const ImVec2 uva(0.0, 1.0);
+
+    // One pixel per frame, the newest at the right edge.
+    size_t newest = stft->size();
+    for(float x=width-1; x>=0 && newest > 0; x-=1.0f) {
+        GLBitmap* bm = cache->at(--newest);
+        if (!bm) break;
+        ImVec2 pos0 = inner_bb.Min + ImVec2(x, top);
+        ImVec2 pos1 = inner_bb.Min + ImVec2(x+1, bot);
+        window->DrawList->AddImage(ImTextureID(bm->imtexture()), pos0, pos1, uva, uvb);
+    }
+
+    ImGui::RenderTextClipped(ImVec2(frame_bb.Min.x, frame_bb.Min.y + style.FramePadding.y),
+                      frame_bb.Max, label, nullptr, nullptr, ImVec2(0.5f,0.0f));
+
+    // The vertical scale.
+    float hh = bot - top;
+    float vn = std::max(1.0f, truncf(hh / ticksize.y) - 1);
+    for(float i=0; i<=vn; i+=1.0f) {
+        float y = bot - i * hh / vn;
+        double row = i / vn * cache->rows();
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.0f Hz", cache->RowFrequency(row));
+        ImGui::RenderText(inner_bb.Min + ImVec2(8, y - ticksize.y/2.0f), buf, nullptr, false);
+        window->DrawList->AddLine(inner_bb.Min + ImVec2(0, y),
+                                  inner_bb.Min + ImVec2(4, y), 0xFFFFFFFF);
+    }
+
+    float mx = g.IO.MousePos.x - inner_bb.Min.x;
+    float my = g.IO.MousePos.y - inner_bb.Min.y;
+    if (hovered && my >= top && my < bot) {
+        size_t back = size_t(width - mx);
+        int row = int((bot - my) / hh * cache->rows());
+        if (back < stft->size()) {
+            ImGui::SetTooltip("bin=%.0f Hz\nmag=%.2f dB",
+                    cache->RowFrequency(row),
+                    stft->PowerDb(stft->size() - 1 - back, row));
+        }
+    }
+
+    ImGui::PushID(cache);
+    ImGui::PushItemWidth(100);
+    if (ImGui::InputFloat("Floor", &cache->floor(), 1.0, 10.0)) {
+        cache->Redraw();
+    }
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    ImGui::Text("Latency %.0f ms, %llu samples dropped",
+                1000.0 * stft->backlog(),
+                (unsigned long long)stft->dropped());
+    ImGui::PopID();
+}
@@ -0,0 +1,55 @@
+#ifndef WVLX_IMWIDGET_LIVE_DISPLAY_H
+#define WVLX_IMWIDGET_LIVE_DISPLAY_H
+#include <memory>
+#include <vector>
+
+#include "audio/stream_stft.h"
+#include "imwidget/glbitmap.h"
+#include "imgui.h"
+
+namespace audio {
+
+// Column bitmaps for a StreamingSTFT.  There is one per frame of history,
+// reused in a ring as new frames arrive, so a scrolling display only ever
+// draws each frame once.
+class LiveCache {
+  public:
+    explicit LiveCache(const StreamingSTFT* stft)
+      : stft_(stft),
+      columns_(stft->history()),
+      drawn_(stft->history(), kNone) {}
+
+    // Draws the frames computed since the last call.  Call from the
+    // thread that runs the STFT's Process.
+    void Update();
+    // Discards every bitmap, e.g. after the floor changes.
+    void Redraw();
+    // The bitmap of frame |n|, or nullptr if it has aged out or isn't
+    // drawn yet.
+    GLBitmap* at(size_t n);
+
+    inline const StreamingSTFT* stft() const { return stft_; }
+    inline int rows() const { return stft_->fftsz() / 2; }
+    inline double RowFrequency(double row) const {
+        return row * stft_->rate() / stft_->fftsz();
+    }
+    // Return a ref so imgui can adjust it.
+    inline float& floor() { return floor_; }
+  private:
+    static constexpr size_t kNone = ~size_t(0);
+    const StreamingSTFT* stft_;
+    std::vector<std::unique_ptr<GLBitmap>> columns_;
+    // The frame each column holds.
+    std::vector<size_t> drawn_;
+    size_t next_ = 0;
+    float floor_ = -50.0;
+    std::vector<float> db_;
+};
+
+}  // namespace audio
+
+// Draws the most recent frames of |cache|, newest at the right edge.
+void LiveDisplay(const char* label, audio::LiveCache* cache,
+                 ImVec2 graph_size=ImVec2(0, 256));
+
+#endif // WVLX_IMWIDGET_LIVE_DISPLAY_H
@@ -21,7 +21,9 @@ int main(int argc, char *argv[]) {
 
     project::App app("Empty Project");
     app.Init();
-    app.Load(argv[1]);
+    if (argc > 1) {
+        app.Load(argv[1]);
+    }
     app.Run();
 
     return 0;
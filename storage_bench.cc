@@ -0,0 +1,114 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include "audio/fft_channel.h"
+#include "util/sound/file.h"
+#include "util/sound/sample.h"
+
+DEFINE_double(seconds, 600, "Length of the synthetic signal");
+DEFINE_double(rate, 48000, "Sample rate of the synthetic signal");
+DEFINE_int32(fftsz, 4096, "FFT size for the Analyze timing");
+DEFINE_int32(threads, 0, "Analyze threads; 0 uses every hardware thread.");
+DEFINE_int32(repeat, 3, "Runs of each timing; the fastest is reported.");
+
+const char kUsage[] =
+R"ZZZ(<optional flags>
+
+Description:
+  Times what the compact channel storage formats cost: encoding on load,
+  per-sample reads through at(), block reads, and a full FFT analysis,
+  for Float, Int16 and Half channels holding the same signal.
+)ZZZ";
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template<typename Fn>
+double Best(Fn fn) {
+    double best = 0;
+    for(int r=0; r<FLAGS_repeat; ++r) {
+        auto start = Clock::now();
+        fn();
+        double s = std::chrono::duration<double>(Clock::now() - start).count();
+        if (r == 0 || s < best) best = s;
+    }
+    return best;
+}
+
+const char* Name(sound::SampleFormat fmt) {
+    switch(fmt) {
+        case sound::SampleFormat::Int16: return "int16";
+        case sound::SampleFormat::Half: return "half";
+        default: return "float";
+    }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    gflags::SetUsageMessage(kUsage);
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    if (argc != 1) {
+        fprintf(stderr, "Usage: %s %s", argv[0], kUsage);
+        return 1;
+    }
+
+    size_t samples = size_t(FLAGS_seconds * FLAGS_rate);
+    std::vector<float> signal(samples);
+    for(size_t i=0; i<samples; ++i) {
+        double t = i / FLAGS_rate;
+        signal[i] = 0.5 * sin(2 * M_PI * 440 * t) +
+                    0.25 * sin(2 * M_PI * 3520 * t);
+    }
+
+    printf("%zu samples, %d threads\n", samples, FLAGS_threads);
+    printf("%-6s %10s %10s %10s %10s\n",
+           "format", "fill", "at()", "read", "analyze");
+    constexpr size_t kBlock = 4096;
+    std::vector<float> block(kBlock);
+    for(auto fmt : {sound::SampleFormat::Float, sound::SampleFormat::Int16,
+                    sound::SampleFormat::Half}) {
+        sound::Channel channel(samples, FLAGS_rate, fmt);
+        double fill = Best([&]() {
+            for(size_t i=0; i<samples; i+=kBlock) {
+                channel.Fill(i, signal.data() + i,
+                             std::min(kBlock, samples - i));
+            }
+        });
+
+        // The sum keeps the reads from being optimized away.
+        volatile float sink = 0;
+        double at = Best([&]() {
+            float sum = 0;
+            for(size_t i=0; i<samples; ++i) {
+                sum += channel.at(i / FLAGS_rate);
+            }
+            sink = sum;
+        });
+        double read = Best([&]() {
+            float sum = 0;
+            for(size_t i=0; i<samples; i+=kBlock) {
+                channel.Read(i, block.data(), kBlock);
+                sum += block[0];
+            }
+            sink = sum;
+        });
+        (void)sink;
+
+        audio::FFTChannel fft;
+        fft.set_threads(FLAGS_threads);
+        fft.set_storage(audio::FrameStore::DB);
+        fft.Init(FLAGS_fftsz, FLAGS_fftsz, audio::FFTChannel::WindowFn::HANN,
+                 audio::FFTChannel::Transform::REAL);
+        double analyze = Best([&]() { fft.Analyze(channel); });
+
+        printf("%-6s %9.3fs %9.3fs %9.3fs %9.3fs\n",
+               Name(fmt), fill, at, read, analyze);
+    }
+    return 0;
+}
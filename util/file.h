@@ -69,6 +69,9 @@ class Stat {
     inline int64_t Size() const {
         return stat_.st_size;
     }
+    inline int64_t ModificationTime() const {
+        return stat_.st_mtime;
+    }
     inline mode_t Mode() const {
         return stat_.st_mode;
     }
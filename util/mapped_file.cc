@@ -0,0 +1,85 @@
+#include "util/mapped_file.h"
+
+#include <cerrno>
+#include <memory>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "util/logging.h"
+#include "util/status.h"
+
+#ifdef _WIN32
+std::unique_ptr<MappedFile> MappedFile::Open(const std::string& filename) {
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        LOG(ERROR, "MappedFile could not open ", filename);
+        return nullptr;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY,
+                                        0, 0, nullptr);
+    if (mapping == nullptr) {
+        LOG(ERROR, "MappedFile could not map ", filename);
+        CloseHandle(file);
+        return nullptr;
+    }
+    std::unique_ptr<MappedFile> mf(new MappedFile);
+    mf->file_ = file;
+    mf->mapping_ = mapping;
+    mf->size_ = size.QuadPart;
+    mf->data_ = static_cast<const uint8_t*>(
+            MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (mf->data_ == nullptr) {
+        LOG(ERROR, "MappedFile could not map ", filename);
+        return nullptr;
+    }
+    return mf;
+}
+
+MappedFile::~MappedFile() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_) CloseHandle(file_);
+}
+#else
+std::unique_ptr<MappedFile> MappedFile::Open(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        LOG(ERROR, "MappedFile could not open ", filename, ": ",
+            util::StrError(errno));
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        LOG(ERROR, "MappedFile could not stat ", filename);
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping holds its own reference to the file.
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOG(ERROR, "MappedFile could not map ", filename, ": ",
+            util::StrError(errno));
+        return nullptr;
+    }
+    std::unique_ptr<MappedFile> mf(new MappedFile);
+    mf->data_ = static_cast<const uint8_t*>(data);
+    mf->size_ = st.st_size;
+    return mf;
+}
+
+MappedFile::~MappedFile() {
+    if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+}
+#endif
@@ -0,0 +1,28 @@
+#ifndef WVLX_UTIL_MAPPED_FILE_H
+#define WVLX_UTIL_MAPPED_FILE_H
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// A read-only memory mapping of an entire file.  The operating system's
+// page cache decides which parts of the file are resident.
+class MappedFile {
+  public:
+    static std::unique_ptr<MappedFile> Open(const std::string& filename);
+    ~MappedFile();
+
+    inline const uint8_t* data() const { return data_; }
+    inline int64_t size() const { return size_; }
+
+  private:
+    MappedFile() = default;
+
+    const uint8_t* data_ = nullptr;
+    int64_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+#endif // WVLX_UTIL_MAPPED_FILE_H
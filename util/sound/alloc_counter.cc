@@ -0,0 +1,49 @@
+#include "util/sound/alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace sound {
+namespace testing {
+namespace {
+std::atomic<size_t> live{0};
+std::atomic<size_t> peak{0};
+std::atomic<size_t> discount{0};
+
+// Each block is prefixed with its size, padded to keep the block
+// aligned for any fundamental type.
+constexpr size_t kHeader = alignof(std::max_align_t);
+
+void* Allocate(size_t n) {
+    char* p = static_cast<char*>(malloc(n + kHeader));
+    if (p == nullptr) throw std::bad_alloc();
+    *reinterpret_cast<size_t*>(p) = n;
+    size_t now = live.fetch_add(n) + n - discount.load();
+    size_t old = peak.load();
+    while(now > old && !peak.compare_exchange_weak(old, now)) {}
+    return p + kHeader;
+}
+
+void Free(void* ptr) {
+    if (ptr == nullptr) return;
+    char* p = static_cast<char*>(ptr) - kHeader;
+    live.fetch_sub(*reinterpret_cast<size_t*>(p));
+    free(p);
+}
+}  // namespace
+
+size_t LiveBytes() { return live; }
+size_t PeakBytes() { return peak; }
+void ResetPeak() { peak = live.load() - discount.load(); }
+void Discount(size_t bytes) { discount += bytes; }
+
+}  // namespace testing
+}  // namespace sound
+
+void* operator new(size_t n) { return sound::testing::Allocate(n); }
+void* operator new[](size_t n) { return sound::testing::Allocate(n); }
+void operator delete(void* p) noexcept { sound::testing::Free(p); }
+void operator delete[](void* p) noexcept { sound::testing::Free(p); }
+void operator delete(void* p, size_t) noexcept { sound::testing::Free(p); }
+void operator delete[](void* p, size_t) noexcept { sound::testing::Free(p); }
@@ -0,0 +1,25 @@
+#ifndef WVLX_UTIL_SOUND_ALLOC_COUNTER_H
+#define WVLX_UTIL_SOUND_ALLOC_COUNTER_H
+#include <cstddef>
+
+namespace sound {
+namespace testing {
+
+// Linking alloc_counter replaces the global operator new and delete with
+// versions that track the bytes allocated through them.  Allocations made
+// with malloc, e.g. inside libsndfile, are not counted.
+
+// Bytes currently allocated.
+size_t LiveBytes();
+// The most bytes allocated at once, less any Discount, since the last
+// ResetPeak.
+size_t PeakBytes();
+// Starts measuring the peak from the current live bytes.
+void ResetPeak();
+// Stops counting |bytes| of live memory toward later peaks, for blocks
+// the code under test has finished with but the test keeps alive.
+void Discount(size_t bytes);
+
+}  // namespace testing
+}  // namespace sound
+#endif // WVLX_UTIL_SOUND_ALLOC_COUNTER_H
@@ -0,0 +1,116 @@
+#include "util/sound/batch_loader.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "util/logging.h"
+
+namespace sound {
+
+BatchLoader::BatchLoader(int threads, size_t budget)
+  : budget_(budget) {
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for(int i=0; i<threads; ++i) {
+        workers_.emplace_back(&BatchLoader::Worker, this);
+    }
+}
+
+BatchLoader::~BatchLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        shutdown_ = true;
+    }
+    work_cv_.notify_all();
+    for(auto& t : workers_) {
+        t.join();
+    }
+}
+
+std::future<std::unique_ptr<File>> BatchLoader::Load(
+        const std::string& filename, bool mono, Callback done) {
+    Job job;
+    job.filename = filename;
+    job.mono = mono;
+    job.done = done;
+    auto future = job.result.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        queue_.emplace_back(std::move(job));
+    }
+    work_cv_.notify_one();
+    return future;
+}
+
+std::vector<std::unique_ptr<File>> BatchLoader::LoadAll(
+        const std::vector<std::string>& filenames, bool mono) {
+    std::vector<std::future<std::unique_ptr<File>>> futures;
+    for(const auto& f : filenames) {
+        futures.emplace_back(Load(f, mono));
+    }
+    std::vector<std::unique_ptr<File>> files;
+    for(auto& f : futures) {
+        files.emplace_back(f.get());
+    }
+    return files;
+}
+
+void BatchLoader::Acquire(size_t bytes) {
+    if (budget_ == 0) return;
+    std::unique_lock<std::mutex> lock(mu_);
+    budget_cv_.wait(lock, [&]() {
+        return in_flight_ == 0 || in_flight_ + bytes <= budget_;
+    });
+    in_flight_ += bytes;
+}
+
+void BatchLoader::Release(size_t bytes) {
+    if (budget_ == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        in_flight_ -= bytes;
+    }
+    budget_cv_.notify_all();
+}
+
+void BatchLoader::Worker() {
+    for(;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            work_cv_.wait(lock, [&]() {
+                return shutdown_ || !queue_.empty();
+            });
+            if (queue_.empty()) return;
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        // Probe first so the budget is charged before any channel memory
+        // is allocated; the channels are allocated by the first Decode.
+        auto file = File::Probe(job.filename, job.mono);
+        size_t bytes = 0;
+        if (file) {
+            bytes = file->memory();
+            Acquire(bytes);
+            while(file->Decode() > 0) {}
+        } else {
+            LOG(ERROR, "BatchLoader: could not load ", job.filename);
+        }
+        if (job.done) {
+            job.done(job.filename, file.get());
+        }
+        // The file stays charged until its callback returns, since the
+        // callback may still be copying or holding onto its channels.
+        Release(bytes);
+        job.result.set_value(std::move(file));
+    }
+}
+
+}  // namespace sound
@@ -0,0 +1,67 @@
+#ifndef WVLX_UTIL_SOUND_BATCH_LOADER_H
+#define WVLX_UTIL_SOUND_BATCH_LOADER_H
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util/sound/file.h"
+
+namespace sound {
+
+// Decodes many files concurrently on a fixed pool of worker threads.
+// A file is probed first to learn its size in memory, as stored by the
+// --channel_storage and --channel_memory_mb flags, and its channels are
+// only allocated once the total size of files being decoded fits within
+// the memory budget.  A single file larger than the budget is still
+// decoded, alone.
+class BatchLoader {
+  public:
+    // Called on a worker thread when a file finishes.  |file| is nullptr
+    // if it could not be opened.
+    using Callback = std::function<void(const std::string& filename,
+                                        File* file)>;
+
+    // |threads| defaults to the number of hardware threads.  A |budget|
+    // of zero means no memory limit.
+    explicit BatchLoader(int threads=0, size_t budget=0);
+    // Finishes all queued files before returning.
+    ~BatchLoader();
+
+    // Queues |filename| for decoding and returns a future for the result.
+    std::future<std::unique_ptr<File>> Load(const std::string& filename,
+                                            bool mono=false,
+                                            Callback done=nullptr);
+    // Loads all of |filenames| and returns them in the same order.
+    std::vector<std::unique_ptr<File>> LoadAll(
+            const std::vector<std::string>& filenames, bool mono=false);
+
+  private:
+    struct Job {
+        std::string filename;
+        bool mono;
+        Callback done;
+        std::promise<std::unique_ptr<File>> result;
+    };
+
+    void Worker();
+    void Acquire(size_t bytes);
+    void Release(size_t bytes);
+
+    size_t budget_;
+    size_t in_flight_ = 0;
+    bool shutdown_ = false;
+    std::mutex mu_;
+    std::condition_variable work_cv_;
+    std::condition_variable budget_cv_;
+    std::deque<Job> queue_;
+    std::vector<std::thread> workers_;
+};
+
+}  // namespace sound
+#endif // WVLX_UTIL_SOUND_BATCH_LOADER_H
@@ -0,0 +1,105 @@
+// Checks that BatchLoader charges its memory budget before allocating:
+// with more threads than the budget allows files, the channel memory of
+// files still decoding never exceeds the budget.
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "util/sound/alloc_counter.h"
+#include "util/sound/batch_loader.h"
+#include "util/sound/file.h"
+
+namespace {
+constexpr size_t kFrames = 1 << 20;
+constexpr int kFiles = 6;
+constexpr int kThreads = 4;
+// Room for libsndfile's bookkeeping and the loader's own structures.
+constexpr size_t kSlack = 4 << 20;
+
+std::string TempFile(int i) {
+    const char* dir = getenv("TEST_TMPDIR");
+    return std::string(dir ? dir : "/tmp") + "/batch_loader_test_" +
+           std::to_string(i) + ".wav";
+}
+
+bool WriteStereo(const std::string& filename, int seed) {
+    auto left = std::make_shared<sound::Channel>(kFrames, 48000.0);
+    auto right = std::make_shared<sound::Channel>(kFrames, 48000.0);
+    for(size_t i=0; i<kFrames; ++i) {
+        left->data()[i] = 0.5f * std::sin(0.001f * float(seed + 1) *
+                                          float(i % 6283));
+        right->data()[i] = -left->data()[i];
+    }
+    sound::File file;
+    file.add_channel(left);
+    file.add_channel(right);
+    return file.Save(filename, sound::File::SaveFormat::WavPcm16).ok();
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> filenames;
+    for(int i=0; i<kFiles; ++i) {
+        filenames.emplace_back(TempFile(i));
+        if (!WriteStereo(filenames.back(), i)) {
+            fprintf(stderr, "FAIL: could not write %s\n",
+                    filenames.back().c_str());
+            return 1;
+        }
+    }
+
+    // Room for two files at once; without the budget all four threads
+    // would be decoding together.
+    size_t budget = 2 * sound::File::Probe(filenames[0])->memory();
+    size_t before = sound::testing::LiveBytes();
+    sound::testing::ResetPeak();
+    std::vector<std::unique_ptr<sound::File>> files;
+    {
+        sound::BatchLoader loader(kThreads, budget);
+        std::vector<std::future<std::unique_ptr<sound::File>>> futures;
+        for(const auto& f : filenames) {
+            // Finished files are kept alive by the futures; only count
+            // the ones still decoding.
+            futures.emplace_back(loader.Load(f, false,
+                    [](const std::string&, sound::File* file) {
+                        if (file == nullptr) return;
+                        sound::testing::Discount(
+                                file->channels() * kFrames * sizeof(float));
+                    }));
+        }
+        for(auto& f : futures) {
+            files.emplace_back(f.get());
+        }
+    }
+    size_t peak = sound::testing::PeakBytes() - before;
+    for(const auto& f : filenames) {
+        remove(f.c_str());
+    }
+
+    printf("BatchLoader: peak %zu bytes decoding for a %zu byte budget\n",
+           peak, budget);
+    if (peak > budget + kSlack) {
+        fprintf(stderr, "FAIL: peak allocation exceeds the budget by %zu "
+                        "bytes (limit %zu)\n", peak - budget, kSlack);
+        return 1;
+    }
+    for(int i=0; i<kFiles; ++i) {
+        if (!files[i] || files[i]->channels() != 2 ||
+            files[i]->channel(0)->size() != kFrames) {
+            fprintf(stderr, "FAIL: file %d did not load\n", i);
+            return 1;
+        }
+        float want = 0.5f * std::sin(0.001f * float(i + 1) * 1000.0f);
+        float got = files[i]->channel(0)->sample(1000);
+        if (std::fabs(got - want) > 1e-3f) {
+            fprintf(stderr, "FAIL: file %d sample 1000 is %f, expected %f\n",
+                    i, got, want);
+            return 1;
+        }
+    }
+    printf("PASS\n");
+    return 0;
+}
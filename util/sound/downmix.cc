@@ -0,0 +1,62 @@
+#include "util/sound/downmix.h"
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "util/logging.h"
+#include "util/sound/vector.h"
+
+namespace sound {
+
+Downmix::Downmix(int inputs, int outputs, std::vector<float> weights)
+  : inputs_(inputs),
+  outputs_(outputs),
+  weights_(std::move(weights)) {
+    if (weights_.size() != size_t(inputs_ * outputs_)) {
+        LOG(ERROR, "Downmix: expected ", inputs_ * outputs_,
+                   " weights, got ", weights_.size());
+        weights_.resize(inputs_ * outputs_);
+    }
+}
+
+Downmix Downmix::Mono(int inputs) {
+    return Downmix(inputs, 1, std::vector<float>(inputs, 1.0f / inputs));
+}
+
+Downmix Downmix::ItuStereo() {
+    constexpr float m3db = 0.70710678f;
+    return Downmix(6, 2, {
+        //  L     R     C     LFE   Ls    Rs
+        1.0f, 0.0f, m3db, 0.0f, m3db, 0.0f,
+        0.0f, 1.0f, m3db, 0.0f, 0.0f, m3db,
+    });
+}
+
+Downmix Downmix::Select(int inputs, int channel) {
+    std::vector<float> weights(inputs);
+    weights.at(channel) = 1.0f;
+    return Downmix(inputs, 1, std::move(weights));
+}
+
+void Downmix::Process(const float* const* in, size_t frames,
+                      float* const* out) const {
+    for(int o=0; o<outputs_; ++o) {
+        const float* w = weights_.data() + o * inputs_;
+        bool first = true;
+        for(int i=0; i<inputs_; ++i) {
+            if (w[i] == 0.0f) continue;
+            if (first) {
+                vector::Scale(out[o], in[i], w[i], frames);
+                first = false;
+            } else {
+                vector::MulAdd(out[o], in[i], w[i], frames);
+            }
+        }
+        if (first) {
+            memset(out[o], 0, frames * sizeof(float));
+        }
+    }
+}
+
+}  // namespace sound
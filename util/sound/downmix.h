@@ -0,0 +1,41 @@
+#ifndef WVLX_UTIL_SOUND_DOWNMIX_H
+#define WVLX_UTIL_SOUND_DOWNMIX_H
+#include <cstddef>
+#include <vector>
+
+namespace sound {
+
+// Mixes a set of input channels into a set of output channels using a
+// weight matrix: out[o] = sum over i of weight(o, i) * in[i].
+class Downmix {
+  public:
+    // |weights| is row-major, one row of |inputs| weights per output.
+    Downmix(int inputs, int outputs, std::vector<float> weights);
+
+    // Averages all inputs into a single output.
+    static Downmix Mono(int inputs);
+    // ITU-R BS.775 5.1 (L, R, C, LFE, Ls, Rs) to stereo.  The LFE channel
+    // is dropped.
+    static Downmix ItuStereo();
+    // Passes |channel| through as a single output.
+    static Downmix Select(int inputs, int channel);
+
+    inline int inputs() const { return inputs_; }
+    inline int outputs() const { return outputs_; }
+    inline float weight(int out, int in) const {
+        return weights_[out * inputs_ + in];
+    }
+
+    // Mixes |frames| samples from the planar buffers |in| (one per input)
+    // into the planar buffers |out| (one per output).
+    void Process(const float* const* in, size_t frames,
+                 float* const* out) const;
+
+  private:
+    int inputs_;
+    int outputs_;
+    std::vector<float> weights_;
+};
+
+}  // namespace sound
+#endif // WVLX_UTIL_SOUND_DOWNMIX_H
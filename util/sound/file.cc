@@ -1,19 +1,138 @@
 #include "util/sound/file.h"
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <vector>
 #include <sndfile.h>
 
+#include <gflags/gflags.h>
 #include "util/logging.h"
+#include "util/mapped_file.h"
 #include "util/status.h"
 #include "util/statusor.h"
 #include "absl/memory/memory.h"
 
+DEFINE_string(channel_storage, "float",
+              "Sample storage for decoded channels: float, int16, half or "
+              "auto (int16 for sources of 16 bits or less, else float).");
+DEFINE_int64(channel_memory_mb, 0,
+             "If nonzero, decoded channels larger than this many MiB are "
+             "paged out to a scratch file, keeping at most this much of "
+             "each channel resident.");
+
 namespace sound {
+namespace {
+// Where the samples live inside a mapped WAV file.
+struct WavLayout {
+    int channels = 0;
+    int rate = 0;
+    SampleFormat format = SampleFormat::Float;
+    int sf_subformat = 0;
+    const uint8_t* data = nullptr;
+    uint64_t size = 0;
+};
+
+int SaveFormatToSF(File::SaveFormat format) {
+    switch(format) {
+        case File::SaveFormat::WavFloat:
+            return SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+        case File::SaveFormat::WavPcm16:
+            return SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+        case File::SaveFormat::WavPcm24:
+            return SF_FORMAT_WAV | SF_FORMAT_PCM_24;
+        case File::SaveFormat::FlacPcm16:
+            return SF_FORMAT_FLAC | SF_FORMAT_PCM_16;
+        case File::SaveFormat::FlacPcm24:
+            return SF_FORMAT_FLAC | SF_FORMAT_PCM_24;
+        case File::SaveFormat::W64Float:
+            return SF_FORMAT_W64 | SF_FORMAT_FLOAT;
+        case File::SaveFormat::Rf64Float:
+            return SF_FORMAT_RF64 | SF_FORMAT_FLOAT;
+    }
+    return SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+}
+
+// A uniform variate in [0, 1) from a xorshift32 generator.
+inline float Uniform(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+inline uint16_t Le16(const uint8_t* p) {
+    return uint16_t(p[0] | p[1] << 8);
+}
+inline uint32_t Le32(const uint8_t* p) {
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 |
+           uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+inline uint64_t Le64(const uint8_t* p) {
+    return uint64_t(Le32(p)) | uint64_t(Le32(p + 4)) << 32;
+}
+
+// Walks the RIFF (or RF64) chunk list looking for the "fmt " and "data"
+// chunks.  Only uncompressed PCM and IEEE float are accepted.
+bool ParseWav(const uint8_t* p, uint64_t size, WavLayout* wav) {
+    if (size < 12 || memcmp(p + 8, "WAVE", 4) != 0) return false;
+    bool rf64 = memcmp(p, "RF64", 4) == 0;
+    if (!rf64 && memcmp(p, "RIFF", 4) != 0) return false;
+
+    uint64_t data_size64 = 0;
+    int tag = 0, bits = 0;
+    uint64_t pos = 12;
+    while(pos + 8 <= size) {
+        const uint8_t* chunk = p + pos;
+        uint64_t len = Le32(chunk + 4);
+        pos += 8;
+        if (memcmp(chunk, "ds64", 4) == 0 && len >= 16 && pos + 16 <= size) {
+            data_size64 = Le64(p + pos + 8);
+        } else if (memcmp(chunk, "fmt ", 4) == 0 && len >= 16 &&
+                   pos + len <= size) {
+            tag = Le16(p + pos);
+            wav->channels = Le16(p + pos + 2);
+            wav->rate = Le32(p + pos + 4);
+            bits = Le16(p + pos + 14);
+            // WAVE_FORMAT_EXTENSIBLE keeps the real tag in the subformat GUID.
+            if (tag == 0xFFFE && len >= 26) tag = Le16(p + pos + 24);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (rf64 && len == 0xFFFFFFFF) len = data_size64;
+            if (len > size - pos) len = size - pos;
+            wav->data = p + pos;
+            wav->size = len;
+            break;
+        }
+        pos += len + (len & 1);
+    }
+    if (wav->data == nullptr || wav->channels <= 0 || wav->rate <= 0) {
+        return false;
+    }
+    if (tag == 3 && bits == 32) {
+        wav->format = SampleFormat::Float;
+        wav->sf_subformat = SF_FORMAT_FLOAT;
+    } else if (tag == 1 && bits == 16) {
+        wav->format = SampleFormat::Int16;
+        wav->sf_subformat = SF_FORMAT_PCM_16;
+    } else if (tag == 1 && bits == 24) {
+        wav->format = SampleFormat::Int24;
+        wav->sf_subformat = SF_FORMAT_PCM_24;
+    } else if (tag == 1 && bits == 32) {
+        wav->format = SampleFormat::Int32;
+        wav->sf_subformat = SF_FORMAT_PCM_32;
+    } else {
+        return false;
+    }
+    return true;
+}
+}  // namespace
 
 Channel::Channel(const float* data, size_t samples, double rate, size_t stride)
   : data_(samples),
+  size_(samples),
   interp_(Interpolation::None),
   rate_(rate),
   length_(samples / rate) {
@@ -23,12 +142,75 @@ Channel::Channel(const float* data, size_t samples, double rate, size_t stride)
     }
 }
 
+Channel::Channel(size_t samples, double rate, SampleFormat storage)
+  : size_(samples),
+  interp_(Interpolation::None),
+  rate_(rate),
+  length_(samples / rate) {
+    if (storage != SampleFormat::Int16 && storage != SampleFormat::Half) {
+        data_.resize(samples);
+        return;
+    }
+    format_ = storage;
+    stride_ = SampleSize(storage);
+    raw_.resize(samples * stride_);
+    view_ = raw_.data();
+}
+
+void Channel::Fill(size_t index, const float* data, size_t samples,
+                   size_t stride) {
+    if (pages_) {
+        pages_->Write(index, data, samples, stride);
+        return;
+    }
+    if (!raw_.empty()) {
+        if (index >= size_) return;
+        if (samples > size_ - index) samples = size_ - index;
+        ConvertFromFloat(format_, data, stride,
+                         raw_.data() + index * stride_, samples);
+        return;
+    }
+    if (index >= data_.size()) return;
+    if (samples > data_.size() - index) samples = data_.size() - index;
+    float* dst = data_.data() + index;
+    for(size_t i=0; i<samples; ++i) {
+        dst[i] = *data;
+        data += stride;
+    }
+}
+
+void Channel::Read(size_t index, float* out, size_t n) const {
+    if (pages_) {
+        pages_->Read(index, out, n);
+        return;
+    }
+    size_t i = 0;
+    if (view_ && index < size_) {
+        i = std::min(n, size_ - index);
+        ConvertToFloat(format_, view_ + index * stride_, stride_, out, i);
+    } else if (!view_ && index < size_) {
+        i = std::min(n, size_ - index);
+        memcpy(out, data_.data() + index, i * sizeof(float));
+    }
+    for(; i<n; ++i) {
+        out[i] = 0.0f;
+    }
+}
+
+bool Channel::ReadResident(size_t index, float* out, size_t n) const {
+    if (pages_) {
+        return pages_->ReadResident(index, out, n);
+    }
+    Read(index, out, n);
+    return true;
+}
+
 float Channel::at(double tm) const {
     if (tm < 0.0 || tm >= length_) return 0.0;
     double n = tm * rate_;
     switch(interp_) {
         case Interpolation::None: {
-            return data_.at(int(n));
+            return sample(n);
         }
         case Interpolation::Linear: {
             double f = n - floor(n);
@@ -39,123 +221,420 @@ float Channel::at(double tm) const {
     return 0.0f;
 }
 
-std::unique_ptr<File> File::Load(const std::string& filename) {
-    SF_INFO info;
+File::~File() {
+    Close();
+}
+
+void File::Close() {
+    if (sf_) {
+        sf_close(sf_);
+        sf_ = nullptr;
+    }
+    block_ = std::vector<float>();
+    planes_ = std::vector<float>();
+}
+
+std::unique_ptr<File> File::OpenFile(const std::string& filename) {
+    SF_INFO info = {};
     SNDFILE* fp = sf_open(filename.c_str(), SFM_READ, &info);
     if (fp == nullptr) {
-        LOGF(ERROR, "File::Load could not open %s: %s",
+        LOGF(ERROR, "File::Open could not open %s: %s",
              filename.c_str(), sf_strerror(fp));
         return nullptr;
     }
-    auto data = SFRead(fp, &info);
-    sf_close(fp);
 
     auto file = absl::make_unique<File>();
     file->info_ = info;
+    file->sf_ = fp;
     LOG(INFO, "format:"
             "\n  frames:   ", info.frames,
             "\n  rate:     ", info.samplerate,
             "\n  channels: ", info.channels,
             "\n  format:   ", info.format, "\n");
-    for(int i=0; i<info.channels; i++) {
-        file->channel_.emplace_back(new Channel(data.data()+i,
-                                                info.frames,
-                                                info.samplerate,
-                                                info.channels));
+    return file;
+}
+
+SampleFormat File::StorageFormat() const {
+    if (FLAGS_channel_storage == "int16") {
+        return SampleFormat::Int16;
+    } else if (FLAGS_channel_storage == "half") {
+        return SampleFormat::Half;
+    } else if (FLAGS_channel_storage == "auto") {
+        switch(info_.format & SF_FORMAT_SUBMASK) {
+            case SF_FORMAT_PCM_S8:
+            case SF_FORMAT_PCM_U8:
+            case SF_FORMAT_PCM_16:
+                return SampleFormat::Int16;
+        }
+    }
+    return SampleFormat::Float;
+}
+
+size_t File::PageBudget() const {
+    size_t budget = size_t(FLAGS_channel_memory_mb) << 20;
+    size_t bytes = info_.frames * sizeof(float);
+    return budget && bytes > budget ? budget : 0;
+}
+
+size_t File::memory() const {
+    size_t budget = PageBudget();
+    size_t channel = budget ? budget
+                            : info_.frames * SampleSize(StorageFormat());
+    // The interleaved block, plus a plane per input and output channel.
+    size_t buffers = kBlockFrames * sizeof(float) *
+                     (2 * info_.channels + outputs_);
+    return channel * outputs_ + buffers;
+}
+
+void File::AllocateChannels() {
+    if (!channel_.empty()) return;
+    SampleFormat storage = StorageFormat();
+    size_t budget = PageBudget();
+    for(int i=0; i<outputs_; i++) {
+        std::unique_ptr<PagedStorage> pages;
+        if (budget) {
+            pages = PagedStorage::Create(info_.frames, budget);
+        }
+        if (pages) {
+            channel_.emplace_back(new Channel(std::move(pages),
+                                              info_.samplerate));
+        } else {
+            channel_.emplace_back(new Channel(info_.frames,
+                                              info_.samplerate,
+                                              storage));
+        }
+    }
+}
+
+std::unique_ptr<File> File::Probe(const std::string& filename, bool mono) {
+    auto file = OpenFile(filename);
+    if (file == nullptr) {
+        return nullptr;
+    }
+    file->outputs_ = file->info_.channels;
+    if (mono) {
+        file->mix_ = absl::make_unique<Downmix>(
+                Downmix::Mono(file->info_.channels));
+        file->outputs_ = 1;
     }
     return file;
 }
 
-std::unique_ptr<File> File::LoadAsMono(const std::string& filename) {
-    SF_INFO info;
-    SNDFILE* fp = sf_open(filename.c_str(), SFM_READ, &info);
-    if (fp == nullptr) {
-        LOGF(ERROR, "File::Load could not open %s: %s",
-             filename.c_str(), sf_strerror(fp));
+std::unique_ptr<File> File::Open(const std::string& filename, bool mono) {
+    auto file = Probe(filename, mono);
+    if (file) {
+        file->AllocateChannels();
+    }
+    return file;
+}
+
+std::unique_ptr<File> File::Open(const std::string& filename,
+                                 const Downmix& mix) {
+    auto file = OpenFile(filename);
+    if (file == nullptr) {
         return nullptr;
     }
-    auto data = SFRead(fp, &info);
-    sf_close(fp);
+    if (mix.inputs() != file->info_.channels) {
+        LOG(ERROR, "File::Open: downmix expects ", mix.inputs(),
+                   " channels but ", filename, " has ", file->info_.channels);
+        return nullptr;
+    }
+    file->mix_ = absl::make_unique<Downmix>(mix);
+    file->outputs_ = mix.outputs();
+    file->AllocateChannels();
+    return file;
+}
 
-    auto file = absl::make_unique<File>();
-    file->info_ = info;
-    LOG(INFO, "format:"
-            "\n  frames:   ", info.frames,
-            "\n  rate:     ", info.samplerate,
-            "\n  channels: ", info.channels,
-            "\n  format:   ", info.format, "\n");
+sf_count_t File::Decode(sf_count_t frames) {
+    if (sf_ == nullptr) return 0;
+    AllocateChannels();
+    int channels = info_.channels;
+    block_.resize(frames * channels);
+    sf_count_t n = sf_readf_float(sf_, block_.data(), frames);
+    sf_count_t pos = decoded_;
+    if (n > info_.frames - pos) n = info_.frames - pos;
+    if (n <= 0) {
+        if (pos != info_.frames) {
+            LOGF(ERROR, "File::Decode short read: got %ld, expected %ld",
+                 long(pos), long(info_.frames));
+        }
+        Close();
+        return 0;
+    }
+    if (mix_) {
+        Mix(pos, n);
+    } else if (channels == 1) {
+        channel_[0]->Fill(pos, block_.data(), n);
+    } else {
+        // Split the block into planes first so each channel converts
+        // from a contiguous run, which is what the SIMD encoders need.
+        Deinterleave(n, 0);
+        for(int i=0; i<channels; i++) {
+            channel_[i]->Fill(pos, planes_.data() + i * n, n);
+        }
+    }
+    decoded_ = pos + n;
+    return n;
+}
+
+void File::Deinterleave(sf_count_t n, size_t extra) {
+    // Plane c holds the n samples of input channel c; |extra| more planes
+    // are left after them as scratch.
+    int channels = info_.channels;
+    planes_.resize((channels + extra) * n);
+    for(int c=0; c<channels; ++c) {
+        float* plane = planes_.data() + c * n;
+        const float* src = block_.data() + c;
+        for(sf_count_t i=0; i<n; ++i) {
+            plane[i] = src[i * channels];
+        }
+    }
+}
+
+void File::Mix(sf_count_t pos, sf_count_t n) {
+    // De-interleave the block into planes so the mix runs as contiguous
+    // vector multiply-adds.
+    int channels = info_.channels;
+    Deinterleave(n, mix_->outputs());
+    std::vector<const float*> in(channels);
+    for(int c=0; c<channels; ++c) {
+        in[c] = planes_.data() + c * n;
+    }
+
+    // Mix straight into the channel storage when we can write to it.
+    std::vector<float*> out(mix_->outputs());
+    for(int o=0; o<mix_->outputs(); ++o) {
+        float* data = channel_[o]->data();
+        out[o] = data ? data + pos : planes_.data() + (channels + o) * n;
+    }
+    mix_->Process(in.data(), n, out.data());
+    for(int o=0; o<mix_->outputs(); ++o) {
+        if (channel_[o]->data() == nullptr) {
+            channel_[o]->Fill(pos, out[o], n);
+        }
+    }
+}
 
-    // Sum and average all channels into channel 0
-    for(int i=0; i<info.frames; i++) {
-        int k = i * info.channels;
-        for(int j=1; j<info.channels; j++) {
-            data[k] += data[k+j];
+std::shared_ptr<Channel> Channel::Resample(double rate,
+                                           Resampler::Quality quality) const {
+    constexpr size_t kBlock = 65536;
+    Resampler rs(rate_, rate, quality);
+    size_t samples = size_t(double(size_) * rate / rate_);
+    auto result = std::make_shared<Channel>(samples, rate);
+    std::vector<float> in(kBlock), out(kBlock);
+    size_t pos = 0, done = 0;
+    while(done < samples) {
+        size_t n = rs.Pull(out.data(), std::min(kBlock, samples - done));
+        if (n) {
+            result->Fill(done, out.data(), n);
+            done += n;
+        } else {
+            // Reads past the end are zero, which also flushes the filter.
+            Read(pos, in.data(), kBlock);
+            rs.Push(in.data(), kBlock);
+            pos += kBlock;
         }
-        data[k] /= float(info.channels);
     }
+    return result;
+}
 
-    // Data still strided as channels, so tell Channel about the stride.
-    file->channel_.emplace_back(new Channel(data.data(),
-                                            info.frames,
-                                            info.samplerate,
-                                            info.channels));
+std::unique_ptr<File> File::Map(const std::string& filename) {
+    std::shared_ptr<MappedFile> mf = MappedFile::Open(filename);
+    if (mf == nullptr) {
+        return nullptr;
+    }
+    WavLayout wav;
+    if (!ParseWav(mf->data(), mf->size(), &wav)) {
+        LOG(INFO, "File::Map: ", filename, " is not an uncompressed WAV file");
+        return nullptr;
+    }
+    size_t frame_size = SampleSize(wav.format) * wav.channels;
+    size_t frames = wav.size / frame_size;
 
+    auto file = absl::make_unique<File>();
+    file->info_.frames = frames;
+    file->info_.samplerate = wav.rate;
+    file->info_.channels = wav.channels;
+    file->info_.format = SF_FORMAT_WAV | wav.sf_subformat;
+    file->decoded_ = frames;
+    LOG(INFO, "mapped format:"
+            "\n  frames:   ", file->info_.frames,
+            "\n  rate:     ", file->info_.samplerate,
+            "\n  channels: ", file->info_.channels,
+            "\n  format:   ", file->info_.format, "\n");
+    for(int i=0; i<wav.channels; i++) {
+        file->channel_.emplace_back(new Channel(
+                    mf, wav.data + i * SampleSize(wav.format),
+                    wav.format, frames, frame_size, wav.rate));
+    }
     return file;
 }
 
-util::Status File::Save(const std::string& filename) {
+std::unique_ptr<File> File::Load(const std::string& filename,
+                                 ProgressFn progress) {
+    auto file = Open(filename);
+    if (file == nullptr) {
+        return nullptr;
+    }
+    while(file->Decode() > 0) {
+        if (progress) progress(file->decoded(), file->info_.frames);
+    }
+    return file;
+}
+
+std::unique_ptr<File> File::Load(const std::string& filename,
+                                 const Downmix& mix,
+                                 ProgressFn progress) {
+    auto file = Open(filename, mix);
+    if (file == nullptr) {
+        return nullptr;
+    }
+    while(file->Decode() > 0) {
+        if (progress) progress(file->decoded(), file->info_.frames);
+    }
+    return file;
+}
+
+std::unique_ptr<File> File::LoadAsMono(const std::string& filename,
+                                       ProgressFn progress) {
+    auto file = Open(filename, true);
+    if (file == nullptr) {
+        return nullptr;
+    }
+    while(file->Decode() > 0) {
+        if (progress) progress(file->decoded(), file->info_.frames);
+    }
+    return file;
+}
+
+util::Status File::Save(const std::string& filename, SaveFormat format,
+                        bool dither, double rate) {
     if (channel_.empty()) {
         return util::Status(util::error::Code::INVALID_ARGUMENT,
                 "No channels");
     }
-    SF_INFO info{(sf_count_t)channel_.at(0)->size(),
-                 (int)channel_.at(0)->rate(),
-                 (int)channel_.size(),
-                 SF_FORMAT_WAV | SF_FORMAT_FLOAT};
+    double in_rate = channel_.at(0)->rate();
+    size_t in_frames = channel_.at(0)->size();
     for(const auto& c : channel_) {
-        if (c->size() != (size_t)info.frames) {
+        if (c->size() != in_frames) {
             return util::Status(util::error::Code::INVALID_ARGUMENT,
                     "Not all channels the same length");
         }
-        if (c->rate() != info.samplerate) {
+        if (c->rate() != in_rate) {
             return util::Status(util::error::Code::INVALID_ARGUMENT,
                     "Not all channels the same samplerate");
         }
     }
+    if (rate == 0 || rate == in_rate) rate = in_rate;
+    SF_INFO info{(sf_count_t)(double(in_frames) * rate / in_rate),
+                 (int)rate,
+                 (int)channel_.size(),
+                 SaveFormatToSF(format)};
+
+    // When converting the rate, each channel streams through its own
+    // resampler, fed a block at a time from in_pos.
+    std::vector<std::unique_ptr<Resampler>> resampler;
+    if (rate != in_rate) {
+        for(size_t c=0; c<channel_.size(); ++c) {
+            resampler.emplace_back(new Resampler(in_rate, rate));
+        }
+    }
+    std::vector<float> in_block;
+    std::vector<size_t> in_pos(channel_.size());
+    auto read = [&](int c, sf_count_t pos, float* out, size_t n) {
+        if (resampler.empty()) {
+            channel_[c]->Read(pos, out, n);
+            return;
+        }
+        in_block.resize(kBlockFrames);
+        size_t got = 0;
+        while(got < n) {
+            got += resampler[c]->Pull(out + got, n - got);
+            if (got < n) {
+                channel_[c]->Read(in_pos[c], in_block.data(), kBlockFrames);
+                resampler[c]->Push(in_block.data(), kBlockFrames);
+                in_pos[c] += kBlockFrames;
+            }
+        }
+    };
+
+    float lsb = 0.0f;
+    size_t bytes_per_sample = sizeof(float);
+    switch(info.format & SF_FORMAT_SUBMASK) {
+        case SF_FORMAT_PCM_16:
+            lsb = 1.0f / 32768.0f;
+            bytes_per_sample = 2;
+            break;
+        case SF_FORMAT_PCM_24:
+            lsb = 1.0f / 8388608.0f;
+            bytes_per_sample = 3;
+            break;
+    }
+    // A RIFF WAV can't describe more than 4 GiB of data.
+    uint64_t bytes = uint64_t(info.frames) * info.channels * bytes_per_sample;
+    if ((info.format & SF_FORMAT_TYPEMASK) == SF_FORMAT_WAV &&
+        bytes >= 0xFFFFFF00ull) {
+        LOG(INFO, "File::Save: ", bytes, " bytes won't fit in WAV, "
+                  "writing RF64 instead");
+        info.format = (info.format & ~SF_FORMAT_TYPEMASK) | SF_FORMAT_RF64;
+    }
     LOG(INFO, "format:"
             "\n  frames:   ", info.frames,
             "\n  rate:     ", info.samplerate,
             "\n  channels: ", info.channels,
             "\n  format:   ", info.format, "\n");
 
-    LOG(INFO, "format_check ", sf_format_check(&info));
+    if (!sf_format_check(&info)) {
+        return util::Status(util::error::Code::INVALID_ARGUMENT,
+                "Unsupported output format");
+    }
     SNDFILE *fp = sf_open(filename.c_str(), SFM_WRITE, &info);
     if (fp == nullptr) {
         LOGF(ERROR, "File::Save error %s", sf_strerror(fp));
         return util::Status(util::error::Code::INTERNAL,
                 sf_strerror(fp));
     }
-    size_t frames = channel_.size() * channel_.at(0)->size();
-    std::vector<float> data;
-    for(size_t i=0; i<frames; ++i) {
-        for(const auto& c : channel_) {
-            data.emplace_back(c->sample(i));
-        }
+    if (lsb) {
+        // Saturate rather than wrap anything which exceeds full scale.
+        sf_command(fp, SFC_SET_CLIPPING, nullptr, SF_TRUE);
     }
-    sf_count_t n = sf_write_float(fp, data.data(), data.size());
-    LOGF(INFO, "File::Save wrote %d/%d items", data.size(),n);
-    sf_close(fp);
-    return util::Status::OK;
-}
 
-std::vector<float> File::SFRead(SNDFILE* sf, SF_INFO* info) {
-    std::vector<float> data(info->frames * info->channels);
-    size_t count = sf_read_float(sf, data.data(), data.size());
-    if (count != data.size()) {
-        LOGF(ERROR, "SFRead short read: got %z, expected %z",
-             count, data.size());
+    // Read each channel a block at a time and interleave into a reused
+    // buffer, so the output is never materialized in memory.
+    int channels = info.channels;
+    std::vector<float> plane(kBlockFrames);
+    std::vector<float> block(kBlockFrames * channels);
+    uint32_t seed = 0x12345678;
+    util::Status status = util::Status::OK;
+    for(sf_count_t pos=0; pos < info.frames; pos += kBlockFrames) {
+        sf_count_t n = std::min(kBlockFrames, info.frames - pos);
+        for(int c=0; c<channels; ++c) {
+            read(c, pos, plane.data(), n);
+            float* dst = block.data() + c;
+            if (lsb && dither) {
+                // TPDF dither: the sum of two uniform variates spanning
+                // one LSB each.
+                for(sf_count_t i=0; i<n; ++i) {
+                    float r = Uniform(&seed) - Uniform(&seed);
+                    dst[i * channels] = plane[i] + r * lsb;
+                }
+            } else {
+                for(sf_count_t i=0; i<n; ++i) {
+                    dst[i * channels] = plane[i];
+                }
+            }
+        }
+        sf_count_t wrote = sf_writef_float(fp, block.data(), n);
+        if (wrote != n) {
+            LOG(ERROR, "File::Save short write at frame ", pos, ": ",
+                sf_strerror(fp));
+            status = util::Status(util::error::Code::INTERNAL,
+                    sf_strerror(fp));
+            break;
+        }
     }
-    return data;
+    sf_close(fp);
+    return status;
 }
 
 }  // namespace
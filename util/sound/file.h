@@ -1,11 +1,17 @@
 #ifndef WVLX_UTIL_SOUND_FILE_H
 #define WVLX_UTIL_SOUND_FILE_H
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 #include <sndfile.h>
 
 #include "util/logging.h"
+#include "util/sound/downmix.h"
+#include "util/sound/paged_storage.h"
+#include "util/sound/resampler.h"
+#include "util/sound/sample.h"
 #include "util/status.h"
 #include "util/statusor.h"
 #include "absl/memory/memory.h"
@@ -22,22 +28,84 @@ class Channel {
     Channel(const float* data, size_t samples, double rate, size_t stride=1);
     Channel(size_t samples, double rate)
       : data_(samples),
+       size_(samples),
+       interp_(Interpolation::None),
        rate_(rate),
        length_(samples / rate) {}
+    // Creates a zeroed channel which stores its samples in |storage|
+    // format (Float, Int16 or Half) and converts them to float on access.
+    Channel(size_t samples, double rate, SampleFormat storage);
+    // Creates a read-only channel which views |samples| values of format
+    // |fmt| starting at |data| and |stride| bytes apart.  The samples are
+    // converted to float as they are read.  |backing| owns the memory.
+    Channel(std::shared_ptr<const void> backing, const uint8_t* data,
+            SampleFormat fmt, size_t samples, size_t stride, double rate)
+      : backing_(backing),
+       view_(data),
+       format_(fmt),
+       stride_(stride),
+       size_(samples),
+       interp_(Interpolation::None),
+       rate_(rate),
+       length_(samples / rate) {}
+    // Creates a channel whose samples live in |pages|, which are faulted
+    // in on demand.
+    Channel(std::unique_ptr<PagedStorage> pages, double rate)
+      : pages_(std::move(pages)),
+       size_(pages_->size()),
+       interp_(Interpolation::None),
+       rate_(rate),
+       length_(size_ / rate) {}
 
+    // Copies |samples| values from |data|, stepping by |stride|, into the
+    // channel starting at |index|.
+    void Fill(size_t index, const float* data, size_t samples, size_t stride=1);
+    // Copies |n| samples starting at |index| into |out|.  Samples beyond
+    // the end of the channel read as zero.
+    void Read(size_t index, float* out, size_t n) const;
+    // Like Read, but never waits on disk: samples of a paged channel which
+    // aren't resident read as zero and are fetched in the background.
+    // Returns false if any were missing.  Safe in an audio callback.
+    bool ReadResident(size_t index, float* out, size_t n) const;
     float at(double tm) const;
+    // Returns a copy of this channel converted to |rate|.
+    std::shared_ptr<Channel> Resample(
+            double rate,
+            Resampler::Quality quality=Resampler::Quality::Medium) const;
     inline float sample(size_t index) const {
-        return index < data_.size() ? data_.at(index) : 0.0;
+        if (index >= size_) return 0.0;
+        if (view_) return SampleToFloat(format_, view_ + index * stride_);
+        if (pages_) return pages_->sample(index);
+        return data_[index];
+    }
+    // Returns the writable sample buffer, or nullptr if the samples are
+    // not held in a flat in-memory array.
+    inline float* data() {
+        return (view_ || pages_) ? nullptr : data_.data();
     }
-    inline float* data() { return data_.data(); }
-    inline size_t size() const { return data_.size(); }
+    inline size_t size() const { return size_; }
     inline double rate() const { return rate_; }
     inline double length() const { return length_; }
-    inline void resize(size_t samples) { data_.resize(samples); }
+    inline bool is_view() const { return view_ && raw_.empty(); }
+    inline SampleFormat storage() const { return format_; }
+    inline bool is_paged() const { return pages_ != nullptr; }
+    inline void resize(size_t samples) {
+        if (view_ || pages_) return;
+        data_.resize(samples);
+        size_ = samples;
+    }
     inline void set_interpolation(Interpolation i) { interp_ = i; }
 
   private:
     std::vector<float> data_;
+    // Compact owned storage; view_ points into it.
+    std::vector<uint8_t> raw_;
+    std::shared_ptr<const void> backing_;
+    const uint8_t* view_ = nullptr;
+    std::unique_ptr<PagedStorage> pages_;
+    SampleFormat format_ = SampleFormat::Float;
+    size_t stride_ = sizeof(float);
+    size_t size_;
     Interpolation interp_;
     double rate_;
     double length_;
@@ -45,10 +113,73 @@ class Channel {
 
 class File {
   public:
+    // Frames decoded per sf_readf_float call when streaming a file in.
+    static constexpr sf_count_t kBlockFrames = 65536;
+    // Called after each decoded block with the frames done and total.
+    using ProgressFn = std::function<void(sf_count_t done, sf_count_t total)>;
+
     File() = default;
-    static std::unique_ptr<File> Load(const std::string& filename);
-    static std::unique_ptr<File> LoadAsMono(const std::string& filename);
-    util::Status Save(const std::string& filename);
+    ~File();
+    static std::unique_ptr<File> Load(const std::string& filename,
+                                      ProgressFn progress=nullptr);
+    // Like Load, but averages all channels into a single channel as each
+    // block is decoded.
+    static std::unique_ptr<File> LoadAsMono(const std::string& filename,
+                                            ProgressFn progress=nullptr);
+    // Like Load, but mixes each decoded block through |mix|.  The file
+    // ends up with mix.outputs() channels.
+    static std::unique_ptr<File> Load(const std::string& filename,
+                                      const Downmix& mix,
+                                      ProgressFn progress=nullptr);
+    // Output encodings for Save.  WAV output which would exceed 4 GiB is
+    // written as RF64 instead.
+    enum class SaveFormat {
+        WavFloat = 0,
+        WavPcm16 = 1,
+        WavPcm24 = 2,
+        FlacPcm16 = 3,
+        FlacPcm24 = 4,
+        W64Float = 5,
+        Rf64Float = 6,
+    };
+    // Writes all channels to |filename| a block at a time.  When |dither|
+    // is set, integer formats get TPDF dither before quantization.  If
+    // |rate| is nonzero, the channels are resampled to it as they are
+    // written.
+    util::Status Save(const std::string& filename,
+                      SaveFormat format=SaveFormat::WavFloat,
+                      bool dither=true, double rate=0);
+    // Memory-maps an uncompressed PCM or float WAV (or RF64) file and
+    // exposes each channel as a read-only view of the mapped data chunk.
+    // Nothing is decoded up front; returns nullptr if the file is not a
+    // format which can be viewed in place.
+    static std::unique_ptr<File> Map(const std::string& filename);
+
+    // Opens |filename| and allocates its channels without decoding any
+    // samples.  Call Decode until it returns 0 to stream the file in; the
+    // channels may be read while decoding is in progress and the region
+    // beyond decoded() reads as silence.  If |mono| is set, a single
+    // channel is allocated and each block is mixed down into it.
+    static std::unique_ptr<File> Open(const std::string& filename,
+                                      bool mono=false);
+    // Like Open, but each block is mixed through |mix|, which must have
+    // as many inputs as the file has channels.
+    static std::unique_ptr<File> Open(const std::string& filename,
+                                      const Downmix& mix);
+    // Like Open, but the channels aren't allocated until the first
+    // Decode, so memory() can be checked before committing to it.
+    static std::unique_ptr<File> Probe(const std::string& filename,
+                                       bool mono=false);
+    // Bytes the channels and decode buffers take, or will take once
+    // allocated, given the channel storage format and paging flags.
+    size_t memory() const;
+    // Decodes the next |frames| frames directly into the channels.
+    // Returns the number of frames decoded, or 0 at end of file.
+    sf_count_t Decode(sf_count_t frames=kBlockFrames);
+    inline sf_count_t decoded() const { return decoded_; }
+    inline double progress() const {
+        return info_.frames ? double(decoded_) / double(info_.frames) : 1.0;
+    }
 
     inline size_t channels() { return channel_.size(); }
     std::shared_ptr<Channel> channel(size_t i) { return channel_.at(i); }
@@ -56,9 +187,24 @@ class File {
     const SF_INFO& info() { return info_; }
 
   private:
-    static std::vector<float> SFRead(SNDFILE* sf, SF_INFO* info);
+    static std::unique_ptr<File> OpenFile(const std::string& filename);
+    // The format and, if the channels will be paged, the per-channel
+    // resident budget that AllocateChannels uses.
+    SampleFormat StorageFormat() const;
+    size_t PageBudget() const;
+    void AllocateChannels();
+    void Deinterleave(sf_count_t n, size_t extra);
+    void Mix(sf_count_t pos, sf_count_t n);
+    void Close();
     std::vector<std::shared_ptr<Channel>> channel_;
-    SF_INFO info_;
+    SF_INFO info_ = {};
+    SNDFILE* sf_ = nullptr;
+    std::unique_ptr<Downmix> mix_;
+    // The number of channels to allocate.
+    int outputs_ = 0;
+    std::vector<float> block_;
+    std::vector<float> planes_;
+    std::atomic<sf_count_t> decoded_{0};
 };
 
 }  // namespace
@@ -0,0 +1,76 @@
+// Checks that LoadAsMono decodes straight into its final channel: peak
+// allocation while loading a large stereo file stays at the size of the
+// mono result plus the per-block buffers, instead of holding the
+// interleaved file or a second copy of each channel.
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "util/sound/alloc_counter.h"
+#include "util/sound/file.h"
+
+namespace {
+// About three minutes at 48 kHz: large enough that any whole-file
+// intermediate would dwarf the block buffers.
+constexpr size_t kFrames = 8 << 20;
+// Room for the decode block, the mix planes and small bookkeeping.
+constexpr size_t kSlack = 4 << 20;
+
+std::string TempFile(const char* name) {
+    const char* dir = getenv("TEST_TMPDIR");
+    return std::string(dir ? dir : "/tmp") + "/" + name;
+}
+
+bool WriteStereo(const std::string& filename) {
+    auto left = std::make_shared<sound::Channel>(kFrames, 48000.0);
+    auto right = std::make_shared<sound::Channel>(kFrames, 48000.0);
+    for(size_t i=0; i<kFrames; ++i) {
+        left->data()[i] = 0.5f * std::sin(0.01f * float(i % 6283));
+        right->data()[i] = -left->data()[i] * 0.5f;
+    }
+    sound::File file;
+    file.add_channel(left);
+    file.add_channel(right);
+    return file.Save(filename, sound::File::SaveFormat::WavPcm16).ok();
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string filename = TempFile("file_test_stereo.wav");
+    if (!WriteStereo(filename)) {
+        fprintf(stderr, "FAIL: could not write %s\n", filename.c_str());
+        return 1;
+    }
+
+    size_t before = sound::testing::LiveBytes();
+    sound::testing::ResetPeak();
+    auto file = sound::File::LoadAsMono(filename);
+    size_t peak = sound::testing::PeakBytes() - before;
+    remove(filename.c_str());
+    if (!file || file->channels() != 1 ||
+        file->channel(0)->size() != kFrames) {
+        fprintf(stderr, "FAIL: LoadAsMono did not return one channel of "
+                        "%zu frames\n", kFrames);
+        return 1;
+    }
+
+    size_t result = kFrames * sizeof(float);
+    printf("LoadAsMono: peak %zu bytes for a %zu byte result\n",
+           peak, result);
+    if (peak > result + kSlack) {
+        fprintf(stderr, "FAIL: peak allocation exceeds the result by %zu "
+                        "bytes (limit %zu)\n", peak - result, kSlack);
+        return 1;
+    }
+    // The mono mix of left and right = -left/2 is left/4.
+    float want = 0.25f * 0.5f * std::sin(0.01f * 1000.0f);
+    float got = file->channel(0)->sample(1000);
+    if (std::fabs(got - want) > 1e-3f) {
+        fprintf(stderr, "FAIL: sample 1000 is %f, expected %f\n", got, want);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -7,17 +7,17 @@ constexpr double halfpi = 0.5 * pi;
 constexpr double tau = 2.0 * pi;
 
 namespace sound {
-double Square(double theta, double duty=0.5) {
+inline double Square(double theta, double duty=0.5) {
     theta = fmod(theta, tau);
     return (theta < tau*duty) ? -1.0 : 1.0;
 }
 
-double Saw(double theta) {
+inline double Saw(double theta) {
     theta = fmod(theta, tau);
     return -1.0 + theta / pi;
 }
 
-double Triangle(double theta) {
+inline double Triangle(double theta) {
     theta = fmod(theta, tau);
     if (theta < pi) {
         return -1.0 + theta / halfpi;
@@ -26,5 +26,16 @@ double Triangle(double theta) {
     }
 }
 
+// The zeroth-order modified Bessel function of the first kind, as used
+// by Kaiser windows.
+inline double BesselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for(int k=1; k<64 && term > 1e-12 * sum; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
 }  // namespace sound
 #endif // WVLX_UTIL_SOUND_MATH_H
@@ -0,0 +1,260 @@
+#include "util/sound/paged_storage.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+#include "util/logging.h"
+#include "util/status.h"
+
+namespace sound {
+namespace {
+int Seek(FILE* fp, int64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(fp, offset, SEEK_SET);
+#else
+    return fseeko(fp, offset, SEEK_SET);
+#endif
+}
+
+// The I/O thread also wakes this often, in case a prefetch request's
+// notify raced with it going to sleep.
+constexpr auto kIoPoll = std::chrono::milliseconds(20);
+}  // namespace
+
+std::unique_ptr<PagedStorage> PagedStorage::Create(
+        size_t samples, size_t budget, size_t page_samples) {
+    FILE* scratch = tmpfile();
+    if (scratch == nullptr) {
+        LOG(ERROR, "PagedStorage could not create a scratch file: ",
+            util::StrError(errno));
+        return nullptr;
+    }
+    size_t page_bytes = page_samples * sizeof(float);
+    size_t max_resident = std::max(budget / page_bytes, size_t(2));
+    LOG(INFO, "PagedStorage: ", samples, " samples in pages of ",
+        page_samples, ", at most ", max_resident, " resident");
+    return std::unique_ptr<PagedStorage>(
+            new PagedStorage(scratch, samples, page_samples, max_resident));
+}
+
+PagedStorage::PagedStorage(FILE* scratch, size_t samples,
+                           size_t page_samples, size_t max_resident)
+  : scratch_(scratch),
+  size_(samples),
+  page_samples_(page_samples),
+  max_resident_(max_resident),
+  pages_count_((samples + page_samples - 1) / page_samples),
+  pages_(new Page[pages_count_]) {
+    io_thread_ = std::thread(&PagedStorage::IoWorker, this);
+}
+
+PagedStorage::~PagedStorage() {
+    {
+        std::lock_guard<std::mutex> lock(io_mu_);
+        stop_ = true;
+    }
+    io_cv_.notify_one();
+    io_thread_.join();
+    for(size_t n : resident_) {
+        delete[] pages_[n].data.load();
+    }
+    fclose(scratch_);
+}
+
+const float* PagedStorage::Pin(size_t n) const {
+    Page& page = pages_[n];
+    // Pin before looking at the pointer, and Evict clears the pointer
+    // before looking at the pins, so one of them always sees the other.
+    page.pins.fetch_add(1);
+    const float* data = page.data.load();
+    if (data == nullptr) {
+        page.pins.fetch_sub(1);
+        return nullptr;
+    }
+    page.used.store(clock_.fetch_add(1, std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+    return data;
+}
+
+const float* PagedStorage::PinOrFault(size_t n) const {
+    const float* data = Pin(n);
+    if (data) return data;
+    std::lock_guard<std::mutex> lock(mu_);
+    data = Fault(n);
+    // Evict needs mu_, so the page can't go away before it is pinned.
+    pages_[n].pins.fetch_add(1);
+    return data;
+}
+
+bool PagedStorage::Evict() const {
+    // The least recently used page nobody is reading.
+    std::vector<size_t> order(resident_);
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return pages_[a].used.load(std::memory_order_relaxed) <
+               pages_[b].used.load(std::memory_order_relaxed);
+    });
+    for(size_t n : order) {
+        Page& page = pages_[n];
+        float* data = page.data.exchange(nullptr);
+        if (page.pins.load() != 0) {
+            page.data.store(data);
+            continue;
+        }
+        if (page.dirty) {
+            size_t bytes = page_samples_ * sizeof(float);
+            if (Seek(scratch_, int64_t(n) * bytes) != 0 ||
+                fwrite(data, 1, bytes, scratch_) != bytes) {
+                LOG(ERROR, "PagedStorage could not write page ", n, ": ",
+                    util::StrError(errno));
+            }
+            page.dirty = false;
+        }
+        delete[] data;
+        resident_.erase(std::find(resident_.begin(), resident_.end(), n));
+        return true;
+    }
+    return false;
+}
+
+float* PagedStorage::Fault(size_t n) const {
+    Page& page = pages_[n];
+    page.used.store(clock_.fetch_add(1, std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+    float* data = page.data.load();
+    if (data) return data;
+    // If every page is pinned, go over budget rather than wait.
+    while(resident_.size() >= max_resident_ && Evict()) {}
+
+    size_t bytes = page_samples_ * sizeof(float);
+    data = new float[page_samples_];
+    // Pages past the end of the scratch file have never been written.
+    size_t got = 0;
+    if (Seek(scratch_, int64_t(n) * bytes) == 0) {
+        got = fread(data, 1, bytes, scratch_);
+    }
+    if (got < bytes) {
+        memset(reinterpret_cast<char*>(data) + got, 0, bytes - got);
+    }
+    page.dirty = false;
+    page.data.store(data);
+    resident_.push_back(n);
+    return data;
+}
+
+float PagedStorage::sample(size_t index) const {
+    if (index >= size_) return 0.0f;
+    size_t n = index / page_samples_;
+    float value = PinOrFault(n)[index % page_samples_];
+    Unpin(n);
+    return value;
+}
+
+void PagedStorage::Read(size_t index, float* out, size_t n) const {
+    while(n) {
+        if (index >= size_) {
+            memset(out, 0, n * sizeof(float));
+            return;
+        }
+        size_t offset = index % page_samples_;
+        size_t len = std::min(n, page_samples_ - offset);
+        len = std::min(len, size_ - index);
+        size_t p = index / page_samples_;
+        memcpy(out, PinOrFault(p) + offset, len * sizeof(float));
+        Unpin(p);
+        out += len;
+        index += len;
+        n -= len;
+    }
+}
+
+bool PagedStorage::ReadResident(size_t index, float* out, size_t n) const {
+    bool complete = true;
+    size_t end = index + n;
+    size_t first = end / page_samples_;
+    while(n) {
+        if (index >= size_) {
+            memset(out, 0, n * sizeof(float));
+            break;
+        }
+        size_t offset = index % page_samples_;
+        size_t len = std::min(n, page_samples_ - offset);
+        len = std::min(len, size_ - index);
+        size_t p = index / page_samples_;
+        const float* data = Pin(p);
+        if (data) {
+            memcpy(out, data + offset, len * sizeof(float));
+            Unpin(p);
+        } else {
+            memset(out, 0, len * sizeof(float));
+            first = std::min(first, p);
+            complete = false;
+        }
+        out += len;
+        index += len;
+        n -= len;
+    }
+    // Read ahead by half a page, so sequential playback finds its next
+    // page resident well before it gets there.
+    size_t ahead = end + page_samples_ / 2;
+    size_t last = std::min(pages_count_,
+                           (ahead + page_samples_ - 1) / page_samples_);
+    for(size_t p=first; p<last; ++p) {
+        if (!pages_[p].data.load(std::memory_order_relaxed)) {
+            Prefetch(first, last);
+            break;
+        }
+    }
+    return complete;
+}
+
+void PagedStorage::Prefetch(size_t first, size_t last) const {
+    prefetch_first_.store(first, std::memory_order_relaxed);
+    prefetch_last_.store(last, std::memory_order_release);
+    io_cv_.notify_one();
+}
+
+void PagedStorage::IoWorker() {
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock(io_mu_);
+            io_cv_.wait_for(lock, kIoPoll, [this]() {
+                return stop_ || prefetch_last_.load() != 0;
+            });
+            if (stop_) return;
+        }
+        size_t last = prefetch_last_.exchange(0, std::memory_order_acquire);
+        size_t first = prefetch_first_.load(std::memory_order_relaxed);
+        for(size_t p=first; p<last && p<pages_count_; ++p) {
+            if (pages_[p].data.load()) continue;
+            std::lock_guard<std::mutex> lock(mu_);
+            Fault(p);
+        }
+    }
+}
+
+void PagedStorage::Write(size_t index, const float* data, size_t n,
+                         size_t stride) {
+    if (index >= size_) return;
+    n = std::min(n, size_ - index);
+    std::lock_guard<std::mutex> lock(mu_);
+    while(n) {
+        size_t offset = index % page_samples_;
+        size_t len = std::min(n, page_samples_ - offset);
+        size_t p = index / page_samples_;
+        float* dst = Fault(p) + offset;
+        for(size_t i=0; i<len; ++i) {
+            dst[i] = *data;
+            data += stride;
+        }
+        pages_[p].dirty = true;
+        index += len;
+        n -= len;
+    }
+}
+
+}  // namespace sound
@@ -0,0 +1,103 @@
+#ifndef WVLX_UTIL_SOUND_PAGED_STORAGE_H
+#define WVLX_UTIL_SOUND_PAGED_STORAGE_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sound {
+
+// Float sample storage split into fixed-size pages which live in an
+// anonymous scratch file.  At most |budget| bytes of pages are kept in
+// memory; the least recently used page is written back and dropped when
+// another one needs to be faulted in.  Pages which were never written
+// read as silence.  All methods are safe to call from multiple threads.
+//
+// Resident pages are read without taking a lock: each page table entry
+// holds an atomic pointer and a pin count, and eviction only drops pages
+// nobody has pinned.  Only faults serialize on the mutex, and ReadResident
+// never faults at all, handing missing pages to a background I/O thread
+// instead, so it is safe to call from an audio callback.
+class PagedStorage {
+  public:
+    static constexpr size_t kDefaultPageSamples = 1 << 18;
+
+    static std::unique_ptr<PagedStorage> Create(
+            size_t samples, size_t budget,
+            size_t page_samples=kDefaultPageSamples);
+    ~PagedStorage();
+
+    float sample(size_t index) const;
+    // Copies |n| samples starting at |index| into |out|, faulting in pages
+    // as needed.  Samples beyond the end of the storage read as zero.
+    void Read(size_t index, float* out, size_t n) const;
+    // Like Read, but never blocks on the scratch file: samples in pages
+    // which aren't resident read as zero.  Those pages, and the next half
+    // page after |n|, are fetched in the background.  Returns false if
+    // anything was missing.
+    bool ReadResident(size_t index, float* out, size_t n) const;
+    // Stores |n| samples from |data|, stepping by |stride|, starting at
+    // |index|.
+    void Write(size_t index, const float* data, size_t n, size_t stride=1);
+
+    inline size_t size() const { return size_; }
+    inline size_t page_samples() const { return page_samples_; }
+    inline size_t max_resident() const { return max_resident_; }
+
+  private:
+    struct Page {
+        std::atomic<float*> data{nullptr};
+        // Readers copying out of data right now.
+        std::atomic<int> pins{0};
+        // When the page was last used, for eviction.
+        std::atomic<uint64_t> used{0};
+        // Guarded by mu_.
+        bool dirty = false;
+    };
+
+    PagedStorage(FILE* scratch, size_t samples, size_t page_samples,
+                 size_t max_resident);
+
+    // Pins page |n| and returns its samples if it is resident, or returns
+    // nullptr.  Never blocks.
+    const float* Pin(size_t n) const;
+    inline void Unpin(size_t n) const {
+        pages_[n].pins.fetch_sub(1, std::memory_order_release);
+    }
+    // Pins page |n|, faulting it in first if needed.
+    const float* PinOrFault(size_t n) const;
+    // Makes page |n| resident, reading it from the scratch file if needed,
+    // and returns its samples.  Requires mu_ to be held.
+    float* Fault(size_t n) const;
+    // Drops the least recently used unpinned page, returning false if
+    // every page is pinned.  Requires mu_.
+    bool Evict() const;
+    void Prefetch(size_t first, size_t last) const;
+    void IoWorker();
+
+    FILE* scratch_;
+    size_t size_;
+    size_t page_samples_;
+    size_t max_resident_;
+    size_t pages_count_;
+    std::unique_ptr<Page[]> pages_;
+    mutable std::atomic<uint64_t> clock_{0};
+    // Guards faults, eviction, writes and resident_.
+    mutable std::mutex mu_;
+    mutable std::vector<size_t> resident_;
+
+    // Pages [prefetch_first_, prefetch_last_) wanted by ReadResident.
+    mutable std::atomic<size_t> prefetch_first_{0};
+    mutable std::atomic<size_t> prefetch_last_{0};
+    mutable std::mutex io_mu_;
+    mutable std::condition_variable io_cv_;
+    bool stop_ = false;
+    std::thread io_thread_;
+};
+
+}  // namespace sound
+#endif // WVLX_UTIL_SOUND_PAGED_STORAGE_H
@@ -0,0 +1,107 @@
+#include "util/sound/resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "util/sound/math.h"
+#include "util/sound/vector.h"
+
+namespace sound {
+namespace {
+// Consumed history is only dropped once there is at least this much.
+constexpr size_t kEraseThreshold = 4096;
+
+struct QualityParams {
+    int taps;
+    int phases;
+    double beta;
+    double rolloff;
+};
+
+const QualityParams kQuality[] = {
+    { 16,   64,  6.0, 0.90 },
+    { 32,  256,  8.5, 0.95 },
+    { 64, 1024, 12.0, 0.97 },
+};
+
+double Sinc(double x) {
+    return x == 0.0 ? 1.0 : sin(pi * x) / (pi * x);
+}
+}  // namespace
+
+Resampler::Resampler(double in_rate, double out_rate, Quality quality,
+                     size_t max_push)
+  : in_rate_(in_rate),
+  out_rate_(out_rate),
+  step_(in_rate / out_rate) {
+    const QualityParams& q = kQuality[int(quality)];
+    // When decimating, widen the filter so the transition band stays the
+    // same width relative to the new Nyquist frequency.
+    double ratio = std::min(1.0, out_rate / in_rate);
+    taps_ = int(ceil(q.taps / ratio));
+    taps_ += taps_ & 1;
+    phases_ = q.phases;
+    double fc = 0.5 * ratio * q.rolloff;
+    int half = taps_ / 2;
+
+    // Row p holds the filter sampled at distances j - (half - 1) - p/phases
+    // from the output position, for j in [0, taps).
+    kernel_.resize((phases_ + 1) * taps_);
+    double i0b = BesselI0(q.beta);
+    for(int p=0; p<=phases_; ++p) {
+        double frac = double(p) / double(phases_);
+        float* row = kernel_.data() + p * taps_;
+        for(int j=0; j<taps_; ++j) {
+            double d = double(j - (half - 1)) - frac;
+            double x = d / double(half);
+            double w = std::abs(x) < 1.0
+                ? BesselI0(q.beta * sqrt(1.0 - x*x)) / i0b : 0.0;
+            row[j] = float(2.0 * fc * Sinc(2.0 * fc * d) * w);
+        }
+    }
+    // Push runs on the audio thread: reserve room for the history, the
+    // slack kept below the erase threshold and two blocks, up front.
+    buf_.reserve(taps_ + kEraseThreshold + 2 * max_push);
+    Reset();
+}
+
+void Resampler::Reset() {
+    buf_.assign(taps_ / 2, 0.0f);
+    pos_ = taps_ / 2;
+}
+
+void Resampler::Push(const float* in, size_t n) {
+    // Drop history that no future output can reach before appending.
+    size_t first = size_t(pos_) + 1 - taps_ / 2;
+    if (first > kEraseThreshold && first > buf_.size() / 2) {
+        buf_.erase(buf_.begin(), buf_.begin() + first);
+        pos_ -= first;
+    }
+    buf_.insert(buf_.end(), in, in + n);
+}
+
+float Resampler::Interpolate(size_t index, double frac) const {
+    double p = frac * phases_;
+    int row = int(p);
+    float a = float(p - row);
+    const float* x = buf_.data() + index + 1 - taps_ / 2;
+    const float* k0 = kernel_.data() + row * taps_;
+    float y0 = vector::Dot(x, k0, taps_);
+    float y1 = vector::Dot(x, k0 + taps_, taps_);
+    return y0 + (y1 - y0) * a;
+}
+
+size_t Resampler::Pull(float* out, size_t n) {
+    size_t half = taps_ / 2;
+    size_t i = 0;
+    for(; i<n; ++i) {
+        size_t index = size_t(pos_);
+        if (index + half >= buf_.size()) break;
+        out[i] = Interpolate(index, pos_ - double(index));
+        pos_ += step_;
+    }
+    return i;
+}
+
+}  // namespace sound
@@ -0,0 +1,54 @@
+#ifndef WVLX_UTIL_SOUND_RESAMPLER_H
+#define WVLX_UTIL_SOUND_RESAMPLER_H
+#include <cstddef>
+#include <vector>
+
+namespace sound {
+
+// A streaming windowed-sinc sample-rate converter.  The filter is stored
+// as a polyphase table; each output sample is the dot product of the input
+// history with the two nearest phases, linearly blended.
+class Resampler {
+  public:
+    enum class Quality {
+        Fast = 0,       // 16 taps, 64 phases
+        Medium = 1,     // 32 taps, 256 phases
+        Best = 2,       // 64 taps, 1024 phases
+    };
+
+    // Push never allocates as long as each call appends at most |max_push|
+    // samples and the output is pulled before the next push.
+    Resampler(double in_rate, double out_rate, Quality quality=Quality::Medium,
+              size_t max_push=65536);
+
+    // Forgets all history, as if the next input were preceded by silence.
+    void Reset();
+    // Appends |n| input samples.
+    void Push(const float* in, size_t n);
+    // Produces up to |n| output samples from the input pushed so far and
+    // returns how many were produced.  Output k is the input signal
+    // evaluated at time k * in_rate / out_rate.
+    size_t Pull(float* out, size_t n);
+
+    inline double in_rate() const { return in_rate_; }
+    inline double out_rate() const { return out_rate_; }
+    // The number of input samples of lookahead each output needs.
+    inline int delay() const { return taps_ / 2; }
+
+  private:
+    float Interpolate(size_t index, double frac) const;
+
+    double in_rate_;
+    double out_rate_;
+    double step_;
+    int taps_;
+    int phases_;
+    // (phases_ + 1) rows of taps_ coefficients.
+    std::vector<float> kernel_;
+    std::vector<float> buf_;
+    // Position of the next output in buf_, in input samples.
+    double pos_;
+};
+
+}  // namespace sound
+#endif // WVLX_UTIL_SOUND_RESAMPLER_H
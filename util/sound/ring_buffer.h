@@ -0,0 +1,79 @@
+#ifndef WVLX_UTIL_SOUND_RING_BUFFER_H
+#define WVLX_UTIL_SOUND_RING_BUFFER_H
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+namespace sound {
+
+// A lock-free ring of samples for one producer thread and one consumer
+// thread, e.g. an audio callback and the thread that analyzes its input.
+// Neither Write nor Read allocates, locks or blocks.
+class RingBuffer {
+  public:
+    // Holds at least |capacity| samples; the size is rounded up to a
+    // power of two.
+    explicit RingBuffer(size_t capacity) {
+        size_ = 1;
+        while(size_ < capacity) size_ *= 2;
+        data_.reset(new float[size_]);
+    }
+
+    // Producer: appends up to |n| samples and returns how many fit.  The
+    // rest are dropped.
+    size_t Write(const float* src, size_t n) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        n = std::min(n, size_ - (head - tail));
+        size_t at = head & (size_ - 1);
+        size_t first = std::min(n, size_ - at);
+        memcpy(data_.get() + at, src, first * sizeof(float));
+        memcpy(data_.get(), src + first, (n - first) * sizeof(float));
+        head_.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer: removes up to |n| samples into |dst| and returns how many
+    // there were.
+    size_t Read(float* dst, size_t n) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        n = std::min(n, head - tail);
+        size_t at = tail & (size_ - 1);
+        size_t first = std::min(n, size_ - at);
+        memcpy(dst, data_.get() + at, first * sizeof(float));
+        memcpy(dst + first, data_.get(), (n - first) * sizeof(float));
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer: discards up to |n| of the oldest samples.
+    size_t Skip(size_t n) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        n = std::min(n, head - tail);
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // Samples waiting to be read.  Exact on the consumer thread; a lower
+    // bound anywhere else.
+    inline size_t available() const {
+        return head_.load(std::memory_order_acquire) -
+               tail_.load(std::memory_order_acquire);
+    }
+    inline size_t capacity() const { return size_; }
+
+  private:
+    size_t size_;
+    std::unique_ptr<float[]> data_;
+    // Free-running counts of samples written and read; only their
+    // difference and their low bits matter.
+    std::atomic<size_t> head_{0};
+    std::atomic<size_t> tail_{0};
+};
+
+}  // namespace sound
+#endif // WVLX_UTIL_SOUND_RING_BUFFER_H
@@ -0,0 +1,109 @@
+#include "util/sound/sample.h"
+
+#include <cmath>
+#include <cstring>
+#if defined(__SSE2__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace sound {
+namespace {
+inline int16_t FloatToInt16(float f) {
+    float v = nearbyintf(f * 32768.0f);
+    if (v > 32767.0f) return 32767;
+    if (v < -32768.0f) return -32768;
+    return int16_t(v);
+}
+}  // namespace
+
+void ConvertToFloat(SampleFormat fmt, const uint8_t* src, size_t stride,
+                    float* dst, size_t n) {
+    size_t i = 0;
+    if (fmt == SampleFormat::Float && stride == sizeof(float)) {
+        memcpy(dst, src, n * sizeof(float));
+        return;
+    }
+#if defined(__SSE2__)
+    if (fmt == SampleFormat::Int16 && stride == 2) {
+        const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+        for(; i+8 <= n; i+=8) {
+            __m128i v = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(src + 2*i));
+            // Unpack each int16 into the top half of an int32, then
+            // arithmetic shift to sign-extend.
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(dst+i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+            _mm_storeu_ps(dst+i+4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        }
+    }
+#endif
+#if defined(__F16C__)
+    if (fmt == SampleFormat::Half && stride == 2) {
+        for(; i+8 <= n; i+=8) {
+            __m128i v = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(src + 2*i));
+            _mm256_storeu_ps(dst+i, _mm256_cvtph_ps(v));
+        }
+    }
+#endif
+    for(src += i * stride; i<n; ++i, src+=stride) {
+        dst[i] = SampleToFloat(fmt, src);
+    }
+}
+
+void ConvertFromFloat(SampleFormat fmt, const float* src, size_t src_stride,
+                      uint8_t* dst, size_t n) {
+    size_t i = 0;
+    switch(fmt) {
+        case SampleFormat::Float:
+            for(; i<n; ++i, src+=src_stride, dst+=sizeof(float)) {
+                memcpy(dst, src, sizeof(float));
+            }
+            break;
+        case SampleFormat::Int16: {
+#if defined(__SSE2__)
+            if (src_stride == 1) {
+                const __m128 scale = _mm_set1_ps(32768.0f);
+                for(; i+8 <= n; i+=8) {
+                    __m128i lo = _mm_cvtps_epi32(
+                            _mm_mul_ps(_mm_loadu_ps(src+i), scale));
+                    __m128i hi = _mm_cvtps_epi32(
+                            _mm_mul_ps(_mm_loadu_ps(src+i+4), scale));
+                    // packs saturates, which clips to full scale.
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2*i),
+                                     _mm_packs_epi32(lo, hi));
+                }
+            }
+#endif
+            for(; i<n; ++i) {
+                int16_t v = FloatToInt16(src[i * src_stride]);
+                dst[2*i] = uint8_t(v);
+                dst[2*i+1] = uint8_t(uint16_t(v) >> 8);
+            }
+            break;
+        }
+        case SampleFormat::Half: {
+#if defined(__F16C__)
+            if (src_stride == 1) {
+                for(; i+8 <= n; i+=8) {
+                    __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src+i),
+                                                _MM_FROUND_TO_NEAREST_INT);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2*i), h);
+                }
+            }
+#endif
+            for(; i<n; ++i) {
+                uint16_t h = FloatToHalf(src[i * src_stride]);
+                dst[2*i] = uint8_t(h);
+                dst[2*i+1] = uint8_t(h >> 8);
+            }
+            break;
+        }
+        default:
+            memset(dst, 0, n * SampleSize(fmt));
+            break;
+    }
+}
+
+}  // namespace sound
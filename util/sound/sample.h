@@ -0,0 +1,126 @@
+#ifndef WVLX_UTIL_SOUND_SAMPLE_H
+#define WVLX_UTIL_SOUND_SAMPLE_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace sound {
+
+// Encodings a Channel can read its samples from.  All integer formats are
+// little-endian signed PCM; Half is IEEE 754 binary16.
+enum class SampleFormat {
+    Float = 0,
+    Int16 = 1,
+    Int24 = 2,
+    Int32 = 3,
+    Half = 4,
+};
+
+inline size_t SampleSize(SampleFormat fmt) {
+    switch(fmt) {
+        case SampleFormat::Float: return 4;
+        case SampleFormat::Int16: return 2;
+        case SampleFormat::Int24: return 3;
+        case SampleFormat::Int32: return 4;
+        case SampleFormat::Half: return 2;
+    }
+    return 0;
+}
+
+inline float HalfToFloat(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1F;
+    uint32_t mant = h & 0x3FF;
+    uint32_t bits;
+    if (exp == 0) {
+        if (mant == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: shift the mantissa up until it is normalized.
+            int e = -1;
+            do {
+                ++e;
+                mant <<= 1;
+            } while((mant & 0x400) == 0);
+            bits = sign | uint32_t(127 - 15 - e) << 23 | (mant & 0x3FF) << 13;
+        }
+    } else if (exp == 0x1F) {
+        bits = sign | 0x7F800000 | mant << 13;
+    } else {
+        bits = sign | (exp + 127 - 15) << 23 | mant << 13;
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint16_t FloatToHalf(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint16_t sign = (x >> 16) & 0x8000;
+    if ((x & 0x7FFFFFFF) > 0x7F800000) return sign | 0x7E00;
+    int32_t exp = int32_t((x >> 23) & 0xFF) - 127 + 15;
+    uint32_t mant = x & 0x7FFFFF;
+    if (exp >= 0x1F) return sign | 0x7C00;
+    if (exp <= 0) {
+        if (exp < -10) return sign;
+        mant |= 0x800000;
+        int shift = 14 - exp;
+        uint16_t h = uint16_t(mant >> shift);
+        uint32_t rest = mant & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        // Round to nearest, ties to even, as F16C's vcvtps2ph does.
+        if (rest > half || (rest == half && (h & 1))) ++h;
+        return sign | h;
+    }
+    // A carry out of the mantissa correctly bumps the exponent.
+    uint16_t h = sign | uint16_t(exp << 10) | uint16_t(mant >> 13);
+    uint32_t rest = mant & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) ++h;
+    return h;
+}
+
+// Converts the sample at |p| to a float in the range [-1.0, 1.0).
+inline float SampleToFloat(SampleFormat fmt, const uint8_t* p) {
+    switch(fmt) {
+        case SampleFormat::Float: {
+            float f;
+            memcpy(&f, p, sizeof(f));
+            return f;
+        }
+        case SampleFormat::Int16: {
+            int16_t v = int16_t(p[0] | p[1] << 8);
+            return float(v) * (1.0f / 32768.0f);
+        }
+        case SampleFormat::Int24: {
+            // Assemble in the top 24 bits so the shift sign-extends.
+            int32_t v = int32_t(uint32_t(p[0]) << 8 |
+                                uint32_t(p[1]) << 16 |
+                                uint32_t(p[2]) << 24) >> 8;
+            return float(v) * (1.0f / 8388608.0f);
+        }
+        case SampleFormat::Int32: {
+            int32_t v;
+            memcpy(&v, p, sizeof(v));
+            return float(v) * (1.0f / 2147483648.0f);
+        }
+        case SampleFormat::Half:
+            return HalfToFloat(uint16_t(p[0] | p[1] << 8));
+    }
+    return 0.0f;
+}
+
+// Converts |n| samples, |stride| bytes apart, starting at |src| into
+// floats.  Densely packed Int16 and Half data is converted with SIMD.
+void ConvertToFloat(SampleFormat fmt, const uint8_t* src, size_t stride,
+                    float* dst, size_t n);
+
+// Encodes |n| floats from |src|, stepping by |src_stride| elements, as
+// densely packed samples of format |fmt| at |dst|.  Integer formats are
+// rounded and clipped to full scale.  Only Float, Int16 and Half are
+// supported as destinations.
+void ConvertFromFloat(SampleFormat fmt, const float* src, size_t src_stride,
+                      uint8_t* dst, size_t n);
+
+}  // namespace sound
+#endif // WVLX_UTIL_SOUND_SAMPLE_H
@@ -0,0 +1,409 @@
+#ifndef WVLX_UTIL_SOUND_VECTOR_H
+#define WVLX_UTIL_SOUND_VECTOR_H
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+// Small block kernels over float arrays.  Each uses AVX or SSE when the
+// compiler targets it and finishes the tail (or everything, on other
+// targets) with a scalar loop.  Pointers need not be aligned.
+namespace sound {
+namespace vector {
+
+// dst[i] = src[i] * w
+inline void Scale(float* dst, const float* src, float w, size_t n) {
+    size_t i = 0;
+#if defined(__AVX__)
+    __m256 vw = _mm256_set1_ps(w);
+    for(; i+8 <= n; i+=8) {
+        _mm256_storeu_ps(dst+i, _mm256_mul_ps(_mm256_loadu_ps(src+i), vw));
+    }
+#elif defined(__SSE__)
+    __m128 vw = _mm_set1_ps(w);
+    for(; i+4 <= n; i+=4) {
+        _mm_storeu_ps(dst+i, _mm_mul_ps(_mm_loadu_ps(src+i), vw));
+    }
+#endif
+    for(; i<n; ++i) {
+        dst[i] = src[i] * w;
+    }
+}
+
+// dst[i] = a[i] * b[i]
+inline void Mul(float* dst, const float* a, const float* b, size_t n) {
+    size_t i = 0;
+#if defined(__AVX__)
+    for(; i+8 <= n; i+=8) {
+        _mm256_storeu_ps(dst+i, _mm256_mul_ps(_mm256_loadu_ps(a+i),
+                                              _mm256_loadu_ps(b+i)));
+    }
+#elif defined(__SSE__)
+    for(; i+4 <= n; i+=4) {
+        _mm_storeu_ps(dst+i, _mm_mul_ps(_mm_loadu_ps(a+i),
+                                        _mm_loadu_ps(b+i)));
+    }
+#endif
+    for(; i<n; ++i) {
+        dst[i] = a[i] * b[i];
+    }
+}
+
+// dst[i] = src[i] * w - sub[i]
+inline void ScaleSub(float* dst, const float* src, float w, const float* sub,
+                     size_t n) {
+    size_t i = 0;
+#if defined(__AVX__)
+    __m256 vw = _mm256_set1_ps(w);
+    for(; i+8 <= n; i+=8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src+i), vw);
+        _mm256_storeu_ps(dst+i, _mm256_sub_ps(v, _mm256_loadu_ps(sub+i)));
+    }
+#elif defined(__SSE__)
+    __m128 vw = _mm_set1_ps(w);
+    for(; i+4 <= n; i+=4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(src+i), vw);
+        _mm_storeu_ps(dst+i, _mm_sub_ps(v, _mm_loadu_ps(sub+i)));
+    }
+#endif
+    for(; i<n; ++i) {
+        dst[i] = src[i] * w - sub[i];
+    }
+}
+
+// dst[i] += src[i] * w
+inline void MulAdd(float* dst, const float* src, float w, size_t n) {
+    size_t i = 0;
+#if defined(__AVX__)
+    __m256 vw = _mm256_set1_ps(w);
+    for(; i+8 <= n; i+=8) {
+        __m256 acc = _mm256_loadu_ps(dst+i);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(src+i), vw));
+        _mm256_storeu_ps(dst+i, acc);
+    }
+#elif defined(__SSE__)
+    __m128 vw = _mm_set1_ps(w);
+    for(; i+4 <= n; i+=4) {
+        __m128 acc = _mm_loadu_ps(dst+i);
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(src+i), vw));
+        _mm_storeu_ps(dst+i, acc);
+    }
+#endif
+    for(; i<n; ++i) {
+        dst[i] += src[i] * w;
+    }
+}
+
+// Returns the sum of a[i] * b[i].
+inline float Dot(const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    float sum = 0.0f;
+#if defined(__AVX__)
+    __m256 acc = _mm256_setzero_ps();
+    for(; i+8 <= n; i+=8) {
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a+i),
+                                               _mm256_loadu_ps(b+i)));
+    }
+    __m128 acc4 = _mm_add_ps(_mm256_castps256_ps128(acc),
+                             _mm256_extractf128_ps(acc, 1));
+#elif defined(__SSE__)
+    __m128 acc4 = _mm_setzero_ps();
+    for(; i+4 <= n; i+=4) {
+        acc4 = _mm_add_ps(acc4, _mm_mul_ps(_mm_loadu_ps(a+i),
+                                           _mm_loadu_ps(b+i)));
+    }
+#endif
+#if defined(__AVX__) || defined(__SSE__)
+    // Horizontal sum of the four lanes.
+    acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+    acc4 = _mm_add_ss(acc4, _mm_shuffle_ps(acc4, acc4, 0x55));
+    sum = _mm_cvtss_f32(acc4);
+#endif
+    for(; i<n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// dst[i] = a[i]*a[i] + b[i]*b[i]
+inline void Norm(float* dst, const float* a, const float* b, size_t n) {
+    size_t i = 0;
+#if defined(__AVX__)
+    for(; i+8 <= n; i+=8) {
+        __m256 va = _mm256_loadu_ps(a+i), vb = _mm256_loadu_ps(b+i);
+        _mm256_storeu_ps(dst+i, _mm256_add_ps(_mm256_mul_ps(va, va),
+                                              _mm256_mul_ps(vb, vb)));
+    }
+#elif defined(__SSE__)
+    for(; i+4 <= n; i+=4) {
+        __m128 va = _mm_loadu_ps(a+i), vb = _mm_loadu_ps(b+i);
+        _mm_storeu_ps(dst+i, _mm_add_ps(_mm_mul_ps(va, va),
+                                        _mm_mul_ps(vb, vb)));
+    }
+#endif
+    for(; i<n; ++i) {
+        dst[i] = a[i] * a[i] + b[i] * b[i];
+    }
+}
+
+// Splits |n| interleaved complex values into their real and imaginary
+// parts.
+inline void Deinterleave(float* re, float* im, const float* c, size_t n) {
+    size_t i = 0;
+#if defined(__AVX__)
+    for(; i+8 <= n; i+=8) {
+        __m256 a = _mm256_loadu_ps(c + 2*i);
+        __m256 b = _mm256_loadu_ps(c + 2*i + 8);
+        __m256 lo = _mm256_permute2f128_ps(a, b, 0x20);
+        __m256 hi = _mm256_permute2f128_ps(a, b, 0x31);
+        _mm256_storeu_ps(re+i, _mm256_shuffle_ps(lo, hi, 0x88));
+        _mm256_storeu_ps(im+i, _mm256_shuffle_ps(lo, hi, 0xdd));
+    }
+#elif defined(__SSE__)
+    for(; i+4 <= n; i+=4) {
+        __m128 a = _mm_loadu_ps(c + 2*i);
+        __m128 b = _mm_loadu_ps(c + 2*i + 4);
+        _mm_storeu_ps(re+i, _mm_shuffle_ps(a, b, 0x88));
+        _mm_storeu_ps(im+i, _mm_shuffle_ps(a, b, 0xdd));
+    }
+#endif
+    for(; i<n; ++i) {
+        re[i] = c[2*i];
+        im[i] = c[2*i+1];
+    }
+}
+
+// The approximations below trade the last few bits of precision for
+// speed: FastAtan2 is within 2e-6 radians of atan2f, FastLog10 within
+// 4e-6 of log10f, and FastExp10 within 5e-6 relative of exp10f.  The
+// vector kernels compute the same polynomials.
+inline float FastAtan2(float y, float x) {
+    float ax = fabsf(x), ay = fabsf(y);
+    float mx = ax > ay ? ax : ay;
+    float mn = ax > ay ? ay : ax;
+    float a = mx > 0.0f ? mn / mx : 0.0f;
+    float s = a * a;
+    float r = (((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s
+                + 0.19354346f) * s - 0.33262347f) * s + 0.99997726f) * a;
+    if (ay > ax) r = 1.57079633f - r;
+    if (x < 0.0f) r = 3.14159265f - r;
+    return copysignf(r, y);
+}
+
+inline float FastLog10(float x) {
+    if (!(x > 0.0f)) return -INFINITY;
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    float e = float(int(bits >> 23) - 127);
+    bits = (bits & 0x007fffff) | 0x3f800000;
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+    // Center the mantissa on 1 so the series below converges quickly.
+    if (m > 1.41421356f) {
+        m *= 0.5f;
+        e += 1.0f;
+    }
+    float t = (m - 1.0f) / (m + 1.0f);
+    float t2 = t * t;
+    float ln = 2.0f * t * (((0.14285714f * t2 + 0.2f) * t2
+                            + 0.33333333f) * t2 + 1.0f);
+    return (e * 0.69314718f + ln) * 0.43429448f;
+}
+
+// 10^x, clamped to about [1e-38, 1e38]; -infinity gives zero.
+inline float FastExp10(float x) {
+    float t = x * 3.32192809f;
+    t = t < -126.0f ? -126.0f : (t > 126.0f ? 126.0f : t);
+    float k = rintf(t);
+    float f = (t - k) * 0.69314718f;
+    float p = (((((0.00138889f * f + 0.00833333f) * f + 0.04166667f) * f
+                + 0.16666667f) * f + 0.5f) * f + 1.0f) * f + 1.0f;
+    uint32_t bits = uint32_t(int(k) + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return x == -INFINITY ? 0.0f : p * scale;
+}
+
+// Returns x wrapped onto [-pi, pi].
+inline float WrapPi(float x) {
+    return x - 6.28318531f * rintf(x * 0.15915494f);
+}
+
+#if defined(__AVX__)
+inline __m256 Atan2(__m256 y, __m256 x) {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 ax = _mm256_andnot_ps(sign, x);
+    __m256 ay = _mm256_andnot_ps(sign, y);
+    __m256 mx = _mm256_max_ps(ax, ay);
+    __m256 mn = _mm256_min_ps(ax, ay);
+    __m256 a = _mm256_and_ps(_mm256_div_ps(mn, mx),
+                             _mm256_cmp_ps(mx, _mm256_setzero_ps(),
+                                           _CMP_GT_OQ));
+    __m256 s = _mm256_mul_ps(a, a);
+    __m256 r = _mm256_set1_ps(-0.01172120f);
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(0.05265332f));
+    r = _mm256_sub_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(0.11643287f));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(0.19354346f));
+    r = _mm256_sub_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(0.33262347f));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(0.99997726f));
+    r = _mm256_mul_ps(r, a);
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(1.57079633f), r),
+                         _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(3.14159265f), r),
+                         _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+    return _mm256_or_ps(r, _mm256_and_ps(sign, y));
+}
+#endif
+#if defined(__SSE2__)
+// Selects b where mask is set, else a.
+inline __m128 Select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+}
+
+inline __m128 Atan2(__m128 y, __m128 x) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 ax = _mm_andnot_ps(sign, x);
+    __m128 ay = _mm_andnot_ps(sign, y);
+    __m128 mx = _mm_max_ps(ax, ay);
+    __m128 mn = _mm_min_ps(ax, ay);
+    __m128 a = _mm_and_ps(_mm_div_ps(mn, mx),
+                          _mm_cmpgt_ps(mx, _mm_setzero_ps()));
+    __m128 s = _mm_mul_ps(a, a);
+    __m128 r = _mm_set1_ps(-0.01172120f);
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.05265332f));
+    r = _mm_sub_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.11643287f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.19354346f));
+    r = _mm_sub_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.33262347f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.99997726f));
+    r = _mm_mul_ps(r, a);
+    r = Select(_mm_cmpgt_ps(ay, ax), r,
+               _mm_sub_ps(_mm_set1_ps(1.57079633f), r));
+    r = Select(_mm_cmplt_ps(x, _mm_setzero_ps()), r,
+               _mm_sub_ps(_mm_set1_ps(3.14159265f), r));
+    return _mm_or_ps(r, _mm_and_ps(sign, y));
+}
+
+inline __m128 Log10(__m128 x) {
+    __m128i bits = _mm_castps_si128(x);
+    __m128 e = _mm_sub_ps(_mm_cvtepi32_ps(_mm_srli_epi32(bits, 23)),
+                          _mm_set1_ps(127.0f));
+    bits = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+                        _mm_set1_epi32(0x3f800000));
+    __m128 m = _mm_castsi128_ps(bits);
+    __m128 big = _mm_cmpgt_ps(m, _mm_set1_ps(1.41421356f));
+    m = Select(big, m, _mm_mul_ps(m, _mm_set1_ps(0.5f)));
+    e = _mm_add_ps(e, _mm_and_ps(big, _mm_set1_ps(1.0f)));
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+    __m128 t2 = _mm_mul_ps(t, t);
+    __m128 p = _mm_set1_ps(0.14285714f);
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(0.2f));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(0.33333333f));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), one);
+    __m128 ln = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.0f), t), p);
+    __m128 r = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(e, _mm_set1_ps(0.69314718f)),
+                                     ln),
+                          _mm_set1_ps(0.43429448f));
+    return Select(_mm_cmpgt_ps(x, _mm_setzero_ps()),
+                  _mm_set1_ps(-INFINITY), r);
+}
+
+inline __m128 Exp10(__m128 x) {
+    __m128 t = _mm_mul_ps(x, _mm_set1_ps(3.32192809f));
+    t = _mm_min_ps(_mm_max_ps(t, _mm_set1_ps(-126.0f)),
+                   _mm_set1_ps(126.0f));
+    __m128i k = _mm_cvtps_epi32(t);
+    __m128 f = _mm_mul_ps(_mm_sub_ps(t, _mm_cvtepi32_ps(k)),
+                          _mm_set1_ps(0.69314718f));
+    __m128 p = _mm_set1_ps(0.00138889f);
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.00833333f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.04166667f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.16666667f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.5f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+    __m128 scale = _mm_castsi128_ps(
+            _mm_slli_epi32(_mm_add_epi32(k, _mm_set1_epi32(127)), 23));
+    // -infinity, e.g. an empty bin's dB, becomes exactly zero.
+    return _mm_andnot_ps(_mm_cmpeq_ps(x, _mm_set1_ps(-INFINITY)),
+                         _mm_mul_ps(p, scale));
+}
+#endif
+
+// dst[i] = atan2(y[i], x[i])
+inline void Atan2(float* dst, const float* y, const float* x, size_t n) {
+    size_t i = 0;
+#if defined(__AVX__)
+    for(; i+8 <= n; i+=8) {
+        _mm256_storeu_ps(dst+i, Atan2(_mm256_loadu_ps(y+i),
+                                      _mm256_loadu_ps(x+i)));
+    }
+#elif defined(__SSE2__)
+    for(; i+4 <= n; i+=4) {
+        _mm_storeu_ps(dst+i, Atan2(_mm_loadu_ps(y+i), _mm_loadu_ps(x+i)));
+    }
+#endif
+    for(; i<n; ++i) {
+        dst[i] = FastAtan2(y[i], x[i]);
+    }
+}
+
+// dst[i] = log10(src[i]), or -infinity where src[i] <= 0.
+inline void Log10(float* dst, const float* src, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for(; i+4 <= n; i+=4) {
+        _mm_storeu_ps(dst+i, Log10(_mm_loadu_ps(src+i)));
+    }
+#endif
+    for(; i<n; ++i) {
+        dst[i] = FastLog10(src[i]);
+    }
+}
+
+// dst[i] = 10^src[i]
+inline void Exp10(float* dst, const float* src, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for(; i+4 <= n; i+=4) {
+        _mm_storeu_ps(dst+i, Exp10(_mm_loadu_ps(src+i)));
+    }
+#endif
+    for(; i<n; ++i) {
+        dst[i] = FastExp10(src[i]);
+    }
+}
+
+// dst[i] = src[i] wrapped onto [-pi, pi].
+inline void WrapPi(float* dst, const float* src, size_t n) {
+    size_t i = 0;
+#if defined(__AVX__)
+    const __m256 inv = _mm256_set1_ps(0.15915494f);
+    const __m256 tau = _mm256_set1_ps(6.28318531f);
+    for(; i+8 <= n; i+=8) {
+        __m256 v = _mm256_loadu_ps(src+i);
+        __m256 k = _mm256_round_ps(_mm256_mul_ps(v, inv),
+                                   _MM_FROUND_TO_NEAREST_INT |
+                                   _MM_FROUND_NO_EXC);
+        _mm256_storeu_ps(dst+i, _mm256_sub_ps(v, _mm256_mul_ps(k, tau)));
+    }
+#elif defined(__SSE2__)
+    const __m128 inv = _mm_set1_ps(0.15915494f);
+    const __m128 tau = _mm_set1_ps(6.28318531f);
+    for(; i+4 <= n; i+=4) {
+        __m128 v = _mm_loadu_ps(src+i);
+        __m128 k = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(v, inv)));
+        _mm_storeu_ps(dst+i, _mm_sub_ps(v, _mm_mul_ps(k, tau)));
+    }
+#endif
+    for(; i<n; ++i) {
+        dst[i] = WrapPi(src[i]);
+    }
+}
+
+}  // namespace vector
+}  // namespace sound
+#endif // WVLX_UTIL_SOUND_VECTOR_H
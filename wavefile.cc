@@ -12,6 +12,31 @@ DEFINE_double(samplerate, 48000, "Sample rate");
 DEFINE_double(frequency, 440, "Frequency");
 DEFINE_double(time, 1, "Length (in seconds)");
 DEFINE_string(function, "sin", "Frequency");
+DEFINE_string(format, "wav",
+              "Output format: wav, wav16, wav24, flac16, flac24, w64 or rf64");
+DEFINE_bool(dither, true, "Dither integer output formats");
+
+bool ParseFormat(const std::string& name, sound::File::SaveFormat* format) {
+    using SaveFormat = sound::File::SaveFormat;
+    if (name == "wav") {
+        *format = SaveFormat::WavFloat;
+    } else if (name == "wav16") {
+        *format = SaveFormat::WavPcm16;
+    } else if (name == "wav24") {
+        *format = SaveFormat::WavPcm24;
+    } else if (name == "flac16") {
+        *format = SaveFormat::FlacPcm16;
+    } else if (name == "flac24") {
+        *format = SaveFormat::FlacPcm24;
+    } else if (name == "w64") {
+        *format = SaveFormat::W64Float;
+    } else if (name == "rf64") {
+        *format = SaveFormat::Rf64Float;
+    } else {
+        return false;
+    }
+    return true;
+}
 
 std::shared_ptr<sound::Channel> NewChannel(
         const std::string& function,
@@ -51,11 +76,16 @@ int main(int argc, char *argv[]) {
     gflags::SetUsageMessage(kUsage);
     gflags::ParseCommandLineFlags(&argc, &argv, true);
 
+    sound::File::SaveFormat format;
+    if (!ParseFormat(FLAGS_format, &format)) {
+        LOG(ERROR, "Unknown format ", FLAGS_format);
+        return 1;
+    }
     auto channel = NewChannel(
             FLAGS_function, FLAGS_frequency, FLAGS_time, FLAGS_samplerate);
     sound::File sf;
     sf.add_channel(channel);
-    auto sts = sf.Save(FLAGS_out);
+    auto sts = sf.Save(FLAGS_out, format, FLAGS_dither);
     LOG(INFO, "Save status = ", sts.ToString());
 
     return 0;